@@ -1,145 +1,169 @@
 #define _GLIBCXX_USE_CXX11_ABI 1
-#include <omp.h>
 #include "../src/util/util.h"                       // arguments
-#include "../src/util/file_graph.h"                 // graph
-#include "../src/sampler/vc_sampler.h"              // sampler
-#include "../src/mapper/lookup_mapper.h"            // mapper
-#include "../src/optimizer/triplet_optimizer.h"     // optimizer
+#include "../src/util/precision.h"                  // storage precision
+#include "../src/util/progress.h"                   // schedule
+#include "../src/util/numa_topology.h"              // numa
+#include "../src/trainer/tpr_trainer.h"             // trainer
+
+template<typename T>
+int run(TPRConfig& config, std::string train_ui_path, std::string train_iw_path){
+    try {
+        TPRTrainer<T> trainer(config, train_ui_path, train_iw_path);
+        if (trainer.train() && !trainer.save())
+            return 1;
+    } catch (const std::exception& error) {
+        // a bad config or graph, which the library reports instead of exiting
+        std::cout << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
 int main(int argc, char **argv){
 
-    // arguments
+    // arguments, defaulting to the library's
+    TPRConfig config;
     ArgParser arg_parser(argc, argv);
     std::string train_ui_path = arg_parser.get_str("-train_ui", "", "input user-item graph path");
     std::string train_iw_path = arg_parser.get_str("-train_iw", "", "input item-word graph path");
-    std::string save_name = arg_parser.get_str("-save", "cse.embed", "path for saving mapper");
-    int dimension = arg_parser.get_int("-dimension", 64, "embedding dimension");
-    int num_negative = arg_parser.get_int("-num_negative", 5, "number of negative sample");
-    double update_times = arg_parser.get_double("-update_times", 10, "update times (*million)");
-    double init_alpha = arg_parser.get_double("-init_alpha", 0.1, "init learning rate");
-    double user_reg = arg_parser.get_double("-user_reg", 0.01, "l2 regularization");
-    double item_reg = arg_parser.get_double("-item_reg", 0.01, "l2 regularization");
-    int worker = arg_parser.get_int("-worker", 1, "number of worker (thread)");
+    std::string save_name = arg_parser.get_str("-save", config.save_name, "path for saving mapper");
+    std::string save_format = arg_parser.get_str("-save_format", config.save_format, "text, binary (mmap-able, see embedding_file.h), int8 or pq (see quantized_embedding.h)");
+    std::string aggregation = arg_parser.get_str("-aggregation", config.aggregation, "item-word aggregation: sample (one word) or mean (all words, cached)");
+    int mean_refresh = arg_parser.get_int("-mean_refresh", config.mean_refresh, "recompute a cached word mean after this many reads");
+    int pq_subspaces = arg_parser.get_int("-pq_subspaces", config.pq_subspaces, "one-byte codes per row for -save_format pq, dividing -dimension; 0 for the largest divisor up to dimension/4");
+    std::string checkpoint_name = arg_parser.get_str("-checkpoint", save_name + ".ckpt", "path for checkpoints");
+    double checkpoint_period = arg_parser.get_double("-checkpoint_period", config.checkpoint_period, "checkpoint every (*million) updates, 0 for none");
+    int resume = arg_parser.get_int("-resume", config.resume, "continue from the checkpoint");
+    std::string warm_start = arg_parser.get_str("-warm_start", "", "initialize from a previous text or binary export");
+    std::string table_file = arg_parser.get_str("-table_file", "", "keep the embeddings in this mmapped file, which becomes the binary output");
+    std::string table_advice_name = arg_parser.get_str("-table_advice", "random", "access hint for -table_file: normal, random, sequential or willneed");
+    double table_sync = arg_parser.get_double("-table_sync", config.table_sync, "flush -table_file every (*million) updates, 0 for only at the end");
+    int dimension = arg_parser.get_int("-dimension", config.dimension, "embedding dimension");
+    int num_negative = arg_parser.get_int("-num_negative", config.num_negative, "number of negative sample");
+    int batch_size = arg_parser.get_int("-batch_size", config.batch_size, "mini-batch of (user, item) pairs sharing -num_negative negatives, scored by GEMM; 0 for per-pair updates");
+    int partitions = arg_parser.get_int("-partitions", config.partitions, "train (user part, item part) buckets of this many parts, at least -worker, with in-bucket negatives; 0 for sampling the whole graph");
+    int bucket_passes = arg_parser.get_int("-bucket_passes", config.bucket_passes, "times every bucket is visited with -partitions");
+    double bucket_global = arg_parser.get_double("-bucket_global", config.bucket_global, "share of the -partitions negatives drawn from any part instead of the bucket's");
+    int interleave = arg_parser.get_int("-interleave", config.interleave, "samples in flight: the later ones are drawn ahead and their rows prefetched, 1 for one sample at a time");
+    int samplers = arg_parser.get_int("-samplers", config.samplers, "sampler threads feeding the -worker compute threads through rings, 0 for workers drawing their own samples");
+    int ring_size = arg_parser.get_int("-ring_size", config.ring_size, "samples buffered per compute thread with -samplers");
+    double update_times = arg_parser.get_double("-update_times", config.update_times, "update times (*million)");
+    double init_alpha = arg_parser.get_double("-init_alpha", config.init_alpha, "init learning rate");
+    std::string schedule_name = arg_parser.get_str("-schedule", "linear", "learning rate schedule: linear, cosine or warmup (linear warmup, then linear decay)");
+    double warmup = arg_parser.get_double("-warmup", config.warmup, "fraction of the updates the warmup schedule ramps up over");
+    double user_reg = arg_parser.get_double("-user_reg", config.user_reg, "l2 regularization");
+    double item_reg = arg_parser.get_double("-item_reg", config.item_reg, "l2 regularization");
+    int worker = arg_parser.get_int("-worker", config.worker, "number of worker (thread)");
+    int numa = arg_parser.get_int("-numa", config.numa, "pin workers to NUMA nodes and replicate the samplers on every node");
+    int numa_simulate = arg_parser.get_int("-numa_simulate", config.numa_simulate, "pretend the CPUs form this many NUMA nodes, 0 for the real topology");
+    std::string table_placement_name = arg_parser.get_str("-table_placement", "first_touch", "embedding table pages over the NUMA nodes: first_touch, interleave or partition");
+    int hot_rows = arg_parser.get_int("-hot_rows", config.hot_rows, "replicate the rows of this many highest-degree nodes in every worker, 0 for none");
+    int hot_merge = arg_parser.get_int("-hot_merge", config.hot_merge, "merge a worker's hot row replicas into the table after this many of its updates");
+    double time_budget = arg_parser.get_double("-time_budget", config.time_budget, "stop after this many seconds of training, with the learning rate schedule stretched over them; 0 for none");
+    std::string valid_ui = arg_parser.get_str("-valid_ui", "", "held-out user-item edges, scored by sampled AUC while training; the best rows are kept");
+    double valid_period = arg_parser.get_double("-valid_period", config.valid_period, "seconds between validations");
+    int patience = arg_parser.get_int("-patience", config.patience, "stop after this many validations without improvement, 0 to never stop");
+    int processes = arg_parser.get_int("-processes", config.processes, "tpr processes training one table, each making its share of -update_times");
+    int rank = arg_parser.get_int("-rank", config.rank, "this process among -processes; rank 0 initializes and saves the shared table");
+    std::string shm_name = arg_parser.get_str("-shm_name", "", "share the table with the other processes on this host through this POSIX shared memory object");
+    std::string ps_serve = arg_parser.get_str("-ps_serve", "", "serve the table to -processes clients at unix:/path or host:port, and save it when they are done");
+    std::string ps_connect = arg_parser.get_str("-ps_connect", "", "train a local copy of the table of the parameter server at unix:/path or host:port");
+    double ps_sync = arg_parser.get_double("-ps_sync", config.ps_sync, "push changed rows to the parameter server and pull them back every (*million) updates");
+    int huge_page = arg_parser.get_int("-huge_page", config.huge_page, "back the embedding table by huge pages");
+    std::string precision_name = arg_parser.get_str("-precision", "double", "embedding storage: double, float or bf16");
+    std::string simd = arg_parser.get_str("-simd", "auto", "vector kernels: auto, scalar, sse2, avx2 or avx512");
+    std::string update_rule_name = arg_parser.get_str("-update_rule", "sgd", "row update: sgd, adagrad or adam (lazy, try -init_alpha 0.01)");
 
     if (argc == 1) {
         return 0;
     }
 
-    // main
-    // 0. [FileGraph] read graph
-    std::cout << "(UI-Graph)" << std::endl;
-    FileGraph ui_file_graph(train_ui_path, 0);
-    std::cout << "(IW-Graph)" << std::endl;
-    FileGraph iw_file_graph(train_iw_path, 0, ui_file_graph.index2node);
-
-    // 1. [Sampler] determine what sampler to be used
-    VCSampler ui_sampler(&ui_file_graph);
-    VCSampler iw_sampler(&iw_file_graph);
-
-    // 2. [Mapper] define what embedding mapper to be used
-    LookupMapper i_mapper(iw_sampler.vertex_size, dimension);
-
-    // 3. [Optimizer] claim the optimizer
-    TripletOptimizer optimizer;
-
-    // 4. building the blocks [MF]
-    std::cout << "Start Training:" << std::endl;
-    unsigned long long total_update_times = (unsigned long long)update_times*1000000;
-    unsigned long long worker_update_times = total_update_times/worker;
-    unsigned long long finished_update_times = 0;
-    Monitor monitor(total_update_times);
-
-    omp_set_num_threads(worker);
-    #pragma omp parallel for
-    for (int w=0; w<worker; w++)
-    {
-        int step;
-        long user, item_given, item_pos, item_neg;
-        std::vector<double> user_embed(dimension, 0.0);
-        std::vector<double> item_embed_pos(dimension, 0.0);
-        std::vector<double> item_embed_neg(dimension, 0.0);
-        std::vector<double> user_loss(dimension, 0.0);
-        std::vector<double> item_loss_pos(dimension, 0.0);
-        std::vector<double> item_loss_neg(dimension, 0.0);
-        std::vector<long> user2items, item2words_pos, item2words_neg;
-        unsigned long long update=0, report_period = 10000;
-        double alpha=init_alpha, alpha_min=alpha*0.0001;
-        int trial;
-
-        while (update < worker_update_times)
-        {
-            user = ui_sampler.draw_a_vertex();
-            item_given = ui_sampler.draw_a_context(user);
-            user2items.clear();
-            // [user, item, item, ...]
-            user2items.push_back(user);
-            user2items.push_back(item_given);
-            //ui_sampler.feed_sampled_contexts(user, num_item, user2items); // user-items
-            user_embed = i_mapper.textgcn_embedding(user2items);
-
-            trial = 0.0;
-            for (int b=0; b<num_negative; b++)
-            {
-                item2words_pos.clear();
-                item_pos = ui_sampler.draw_a_context(user);
-                // [item, word, word, ...]
-                item2words_pos.push_back(item_pos);
-                //iw_sampler.feed_sampled_contexts(item_pos, 1, item2words_pos); // item-words
-                iw_sampler.feed_sampled_contexts(item_given, 1, item2words_pos); // item-words
-                item_embed_pos = i_mapper.textgcn_embedding(item2words_pos);
-
-                item2words_neg.clear();
-                item_neg = ui_sampler.draw_a_context_uniformly();
-                // [user, word, word, ...]
-                item2words_neg.push_back(item_neg);
-                //for (int w=0; w<num_word; w++)
-                //    item2words_neg.push_back(iw_sampler.draw_a_negative());
-                iw_sampler.feed_sampled_contexts(item_neg, 1, item2words_neg); // item-words
-                //item2words_neg.push_back(iw_sampler.draw_a_negative());
-                item_embed_neg = i_mapper.textgcn_embedding(item2words_neg);
-
-                optimizer.feed_margin_bpr_loss(user_embed, item_embed_pos, item_embed_neg, 8.0, dimension, user_loss, item_loss_pos, item_loss_neg);
-                //{
-                    //i_mapper.update_with_l2(user, user_loss, alpha, user_reg);
-                    //i_mapper.update_with_l2(item_given, user_loss, alpha, user_reg);
-                    i_mapper.update_with_l2(item_pos, item_loss_pos, alpha, item_reg);
-                    i_mapper.update_with_l2(item_neg, item_loss_neg, alpha, item_reg);
-                    for (auto it=++item2words_pos.begin(); it!=item2words_pos.end(); it++)
-                        i_mapper.update_with_l2(*it, item_loss_pos, alpha, item_reg);
-                    for (auto it=++item2words_neg.begin(); it!=item2words_neg.end(); it++)
-                        i_mapper.update_with_l2(*it, item_loss_neg, alpha, item_reg);
-                    //user_loss.assign(dimension, 0.0);
-                    item_loss_pos.assign(dimension, 0.0);
-                    item_loss_neg.assign(dimension, 0.0);
-                    trial++;
-                    //break;
-                //}
-            }
-            //if (trial)
-            //{
-            i_mapper.update_with_l2(user, user_loss, alpha, user_reg);
-            i_mapper.update_with_l2(item_given, user_loss, alpha, user_reg);
-            //i_mapper.update_with_l2(item_pos, item_loss_pos, alpha/5.0, l2_reg*5.0);
-            //for (auto it=++item2words_pos.begin(); it!=item2words_pos.end(); it++)
-            //    i_mapper.update_with_l2(*it, item_loss_pos, alpha/5.0, l2_reg*5.0);
-            user_loss.assign(dimension, 0.0);
-            //item_loss_pos.assign(dimension, 0.0);
-            //}
-
-            // 5. print progress
-            update++;
-            if (update % report_period == 0) {
-                alpha = init_alpha* ( 1.0 - (double)(finished_update_times)/total_update_times );
-                if (alpha < alpha_min)
-                    alpha = alpha_min;
-                finished_update_times += report_period;
-                monitor.progress(&finished_update_times);
-            }
-        }
+    int precision = parse_precision(precision_name);
+    if (precision == -1) {
+        std::cout << "unknown precision " << precision_name << std::endl;
+        return 1;
+    }
+    int table_advice = parse_advice(table_advice_name);
+    if (table_advice == -1) {
+        std::cout << "unknown table advice " << table_advice_name << std::endl;
+        return 1;
+    }
+    int update_rule = parse_update_rule(update_rule_name);
+    if (update_rule == -1) {
+        std::cout << "unknown update rule " << update_rule_name << std::endl;
+        return 1;
     }
-    monitor.end();
-    i_mapper.save_to_file(&ui_file_graph, ui_file_graph.get_all_nodes(), save_name, 0);
-    i_mapper.save_to_file(&iw_file_graph, iw_file_graph.get_all_to_nodes(), save_name, 1);
+    int table_placement = parse_placement(table_placement_name);
+    if (table_placement == -1) {
+        std::cout << "unknown table placement " << table_placement_name << std::endl;
+        return 1;
+    }
+    int schedule = parse_schedule(schedule_name);
+    if (schedule == -1) {
+        std::cout << "unknown schedule " << schedule_name << std::endl;
+        return 1;
+    }
+    int isa = select_vector_kernels(simd);
+    if (isa == -1) {
+        std::cout << "unknown simd " << simd << std::endl;
+        return 1;
+    }
+    std::cout << "Vector Kernels: " << isa_name(isa) << std::endl;
 
-    return 0;
+    config.save_name = save_name;
+    config.save_format = save_format;
+    config.pq_subspaces = pq_subspaces;
+    config.checkpoint_name = checkpoint_name;
+    config.checkpoint_period = checkpoint_period;
+    config.resume = resume;
+    config.warm_start = warm_start;
+    config.aggregation = aggregation;
+    config.mean_refresh = mean_refresh;
+    config.table_file = table_file;
+    config.table_advice = table_advice;
+    config.table_sync = table_sync;
+    config.dimension = dimension;
+    config.num_negative = num_negative;
+    config.batch_size = batch_size;
+    config.partitions = partitions;
+    config.bucket_passes = bucket_passes;
+    config.bucket_global = bucket_global;
+    config.interleave = interleave;
+    config.samplers = samplers;
+    config.ring_size = ring_size;
+    // every process makes its share of the updates
+    config.update_times = update_times/(processes > 0 ? processes : 1);
+    config.init_alpha = init_alpha;
+    config.schedule = schedule;
+    config.warmup = warmup;
+    config.user_reg = user_reg;
+    config.item_reg = item_reg;
+    config.worker = worker;
+    config.numa = numa;
+    config.numa_simulate = numa_simulate;
+    config.table_placement = table_placement;
+    config.time_budget = time_budget;
+    config.valid_ui = valid_ui;
+    config.valid_period = valid_period;
+    config.patience = patience;
+    config.processes = processes;
+    config.rank = rank;
+    config.shm_name = shm_name;
+    config.ps_serve = ps_serve;
+    config.ps_connect = ps_connect;
+    config.ps_sync = ps_sync;
+    config.hot_rows = hot_rows;
+    config.hot_merge = hot_merge;
+    config.huge_page = huge_page;
+    config.update_rule = update_rule;
+    if (!check_tpr_config(config))
+        return 1;
+
+    // main: 0. [FileGraph] graphs, 1. [Sampler] samplers, 2. [Mapper] table,
+    // 3. [Optimizer] + 4. training, instantiated for the storage precision
+    if (precision == PRECISION_FLOAT)
+        return run<float>(config, train_ui_path, train_iw_path);
+    else if (precision == PRECISION_BFLOAT16)
+        return run<bfloat16>(config, train_ui_path, train_iw_path);
+    return run<double>(config, train_ui_path, train_iw_path);
 }
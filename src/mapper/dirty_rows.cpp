@@ -0,0 +1,75 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <iostream>
+#include "dirty_rows.h"
+
+// reserved, not committed: pages cost memory once something is written to them
+static void* reserve(size_t bytes) {
+    void* buffer = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        std::cout << "fail to reserve " << bytes << " bytes" << std::endl;
+        exit(1);
+    }
+    return buffer;
+}
+
+DirtyRows::DirtyRows(long size, size_t row_bytes) {
+    this->size = size;
+    this->row_bytes = row_bytes;
+    this->marks = new std::atomic<unsigned char>[size];
+    for (long index=0; index<size; index++)
+        this->marks[index].store(0, std::memory_order_relaxed);
+    for (int p=0; p<2; p++)
+    {
+        this->pools[p].used.store(0);
+        this->pools[p].writers.store(0);
+        this->pools[p].indexes = (uint64_t*)reserve(sizeof(uint64_t)*size);
+        this->pools[p].bases = (char*)reserve(row_bytes*size);
+    }
+    this->current.store(0);
+}
+
+DirtyRows::~DirtyRows() {
+    for (int p=0; p<2; p++)
+    {
+        munmap(this->pools[p].indexes, sizeof(uint64_t)*this->size);
+        munmap(this->pools[p].bases, this->row_bytes*this->size);
+    }
+    delete[] this->marks;
+}
+
+void DirtyRows::record(long index, const void* row) {
+    // a row is recorded once per pool: it stays marked until it is cleaned
+    // after the collect() that took its pool, so a pool never overflows
+    for (;;)
+    {
+        int current = this->current.load();
+        DirtyPool& pool = this->pools[current];
+        pool.writers.fetch_add(1);
+        if (this->current.load() == current)
+        {
+            long slot = pool.used.fetch_add(1);
+            memcpy(pool.bases + slot*this->row_bytes, row, this->row_bytes);
+            pool.indexes[slot] = index;
+            pool.writers.fetch_sub(1);
+            return;
+        }
+        // collect() swapped the pools meanwhile
+        pool.writers.fetch_sub(1);
+    }
+}
+
+long DirtyRows::collect(const uint64_t** indexes, const char** bases) {
+    // the other pool was taken by the previous call, and is done with
+    int taken = this->current.load();
+    this->pools[1-taken].used.store(0);
+    this->current.store(1-taken);
+    // writers that joined the taken pool before the swap finish their copies
+    DirtyPool& pool = this->pools[taken];
+    while (pool.writers.load())
+        ;
+    *indexes = pool.indexes;
+    *bases = pool.bases;
+    return pool.used.load();
+}
@@ -0,0 +1,63 @@
+#ifndef DIRTY_ROWS_H
+#define DIRTY_ROWS_H
+#include <stdint.h>
+#include <atomic>
+
+struct DirtyPool {
+    // rows recorded so far, and writers still copying one in
+    std::atomic<long> used;
+    std::atomic<int> writers;
+    uint64_t* indexes;
+    char* bases;
+};
+
+class DirtyRows {
+    /* DirtyRows records which rows of a table the workers wrote since the
+     * last collect(), and a copy of each row as it was right before its first
+     * write, so the writes can be told apart from what the row held at the
+     * last collect. A writer calls touch() before every write; only the
+     * first one of a row pays a copy, the others a load of its mark.
+     * The copies go into one of two pools, which collect() swaps, so the
+     * workers go on recording while the rows of the other pool are sent;
+     * each pool reserves room for every row, but only the pages of the rows
+     * actually recorded are ever touched. A write racing the first one of
+     * its row may land in the copy and be missed, like a lost Hogwild race.
+     */
+    public:
+        long size;
+        size_t row_bytes;
+
+        // constructor
+        DirtyRows(long size, size_t row_bytes);
+        ~DirtyRows();
+        DirtyRows(const DirtyRows&) = delete;
+        DirtyRows& operator=(const DirtyRows&) = delete;
+
+        // call before writing `row`, the bytes of row `index`
+        void touch(long index, const void* row) {
+            if (this->marks[index].load(std::memory_order_relaxed))
+                return;
+            if (!this->marks[index].exchange(1, std::memory_order_acq_rel))
+                this->record(index, row);
+        }
+        // the rows recorded since the last call, with their copies row_bytes
+        // apart; they stay dirty, and their copies valid, until clean()
+        // and the next collect()
+        long collect(const uint64_t** indexes, const char** bases);
+        // the row matches what the table it mirrors holds again
+        void clean(long index) { this->marks[index].store(0, std::memory_order_release); }
+        // marks a clean row for a write that is not to be recorded, e.g.
+        // merging in a fresher copy; 0 if the row is dirty
+        int claim(long index) { return !this->marks[index].exchange(1, std::memory_order_acq_rel); }
+        // records `base` as the copy of a row that stays dirty, e.g. one the
+        // workers wrote while it was being sent, which skipped touch()
+        void rebase(long index, const void* base) { this->record(index, base); }
+
+    private:
+        std::atomic<unsigned char>* marks;
+        DirtyPool pools[2];
+        std::atomic<int> current;
+        void record(long index, const void* row);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "embedding_file.h"
+#include "../util/memory.h"
+
+size_t precision_size(int precision) {
+    if (precision == PRECISION_DOUBLE)
+        return sizeof(double);
+    if (precision == PRECISION_FLOAT)
+        return sizeof(float);
+    return sizeof(bfloat16);
+}
+
+EmbeddingFileHeader make_embedding_file_header(int precision, long rows, int dimension, size_t row_stride_bytes, size_t name_bytes) {
+    EmbeddingFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EMBEDDING_FILE_MAGIC, sizeof(header.magic));
+    header.version = EMBEDDING_FILE_VERSION;
+    header.precision = precision;
+    header.rows = rows;
+    header.dimension = dimension;
+    if (row_stride_bytes == 0)
+        row_stride_bytes = align_size(precision_size(precision)*dimension, CACHE_LINE_SIZE);
+    header.row_stride_bytes = row_stride_bytes;
+    header.matrix_offset = align_size(sizeof(header), EMBEDDING_FILE_PAGE);
+    header.dictionary_offset = align_size(header.matrix_offset + rows*row_stride_bytes, EMBEDDING_FILE_PAGE);
+    header.dictionary_bytes = sizeof(uint64_t)*(rows+1) + name_bytes;
+    return header;
+}
+
+std::vector<uint64_t> dictionary_offsets(std::vector<const char*>& names) {
+    std::vector<uint64_t> offsets(names.size()+1, 0);
+    for (size_t r=0; r<names.size(); r++)
+        offsets[r+1] = offsets[r] + strlen(names[r]) + 1;
+    return offsets;
+}
+
+void write_dictionary(FILE* file, std::vector<const char*>& names, std::vector<uint64_t>& offsets) {
+    fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+    for (size_t r=0; r<names.size(); r++)
+        fwrite(names[r], 1, offsets[r+1]-offsets[r], file);
+}
+
+EmbeddingFile::EmbeddingFile(std::string path) {
+    std::cout << "Load Embedding File:" << std::endl;
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(EmbeddingFileHeader))
+    {
+        if (fd != -1)
+            close(fd);
+        throw std::runtime_error("fail to open file " + path);
+    }
+    this->bytes = info.st_size;
+    this->data = (char*)mmap(NULL, this->bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (this->data == MAP_FAILED)
+        throw std::runtime_error("fail to map file " + path);
+
+    memcpy(&this->header, this->data, sizeof(EmbeddingFileHeader));
+    if (memcmp(this->header.magic, EMBEDDING_FILE_MAGIC, sizeof(this->header.magic))
+        || this->header.version != EMBEDDING_FILE_VERSION
+        || this->header.precision > PRECISION_BFLOAT16
+        || this->header.dictionary_offset + this->header.dictionary_bytes > this->bytes)
+    {
+        munmap(this->data, this->bytes);
+        throw std::runtime_error("not an embedding file (version " + std::to_string(EMBEDDING_FILE_VERSION) + ") " + path);
+    }
+    this->rows = this->header.rows;
+    this->dimension = this->header.dimension;
+    this->precision = this->header.precision;
+    this->offsets = (const uint64_t*)(this->data + this->header.dictionary_offset);
+    this->names = (const char*)(this->offsets + this->rows + 1);
+    std::cout << "\t" << this->rows << " rows, dimension " << this->dimension << " <" << path << ">" << std::endl;
+}
+
+EmbeddingFile::~EmbeddingFile() {
+    munmap(this->data, this->bytes);
+}
+
+double EmbeddingFile::get(long index, int d) {
+    const void* row = this->row(index);
+    if (this->precision == PRECISION_DOUBLE)
+        return ((const double*)row)[d];
+    if (this->precision == PRECISION_FLOAT)
+        return ((const float*)row)[d];
+    return bfloat16_to_float(((const bfloat16*)row)[d]);
+}
+
+std::unordered_map<std::string, long> EmbeddingFile::build_index() {
+    std::unordered_map<std::string, long> index;
+    index.reserve(this->rows);
+    for (long r=0; r<this->rows; r++)
+        index[this->name(r)] = r;
+    return index;
+}
@@ -0,0 +1,78 @@
+#ifndef EMBEDDING_FILE_H
+#define EMBEDDING_FILE_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../util/precision.h"
+
+#define EMBEDDING_FILE_MAGIC "SMOREEMB"
+#define EMBEDDING_FILE_VERSION 1
+#define EMBEDDING_FILE_PAGE 4096
+
+/* Binary embedding file, little-endian, laid out for mmap:
+ *   [header, padded to one page]
+ *   [matrix: rows x row_stride_bytes, page aligned; row r holds `dimension`
+ *    values of the storage precision, zero padded to the stride]
+ *   [dictionary: (rows+1) uint64 offsets into the names, then the names,
+ *    each '\0' terminated; name r is at names + offsets[r]]
+ */
+struct EmbeddingFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t precision;             // PRECISION_*
+    uint64_t rows;
+    uint64_t dimension;
+    uint64_t row_stride_bytes;      // a multiple of 64
+    uint64_t matrix_offset;
+    uint64_t dictionary_offset;
+    uint64_t dictionary_bytes;
+};
+
+// bytes of one stored value for PRECISION_*
+size_t precision_size(int precision);
+
+// header of a file with `rows` rows whose names take `name_bytes` bytes
+// (terminators included); row_stride_bytes = 0 picks the smallest padded stride
+EmbeddingFileHeader make_embedding_file_header(int precision, long rows, int dimension, size_t row_stride_bytes, size_t name_bytes);
+
+// dictionary section: (rows+1) offsets, then the '\0' terminated names;
+// offsets.back() is the name_bytes of the header
+std::vector<uint64_t> dictionary_offsets(std::vector<const char*>& names);
+void write_dictionary(FILE* file, std::vector<const char*>& names, std::vector<uint64_t>& offsets);
+
+class EmbeddingFile {
+    /* EmbeddingFile maps a binary embedding file read-only. Rows and names are
+     * read in place; nothing is copied until get() widens a value.
+     */
+    public:
+        EmbeddingFileHeader header;
+        long rows;
+        int dimension, precision;
+
+        // constructor; throws std::runtime_error if path cannot be mapped or
+        // is not an embedding file
+        EmbeddingFile(std::string path);
+        ~EmbeddingFile();
+        EmbeddingFile(const EmbeddingFile&) = delete;
+        EmbeddingFile& operator=(const EmbeddingFile&) = delete;
+
+        // row access
+        const void* row(long index) { return this->data + this->header.matrix_offset + index*this->header.row_stride_bytes; }
+        double get(long index, int d);
+        const char* name(long index) { return this->names + this->offsets[index]; }
+
+        // name -> row
+        std::unordered_map<std::string, long> build_index();
+
+    private:
+        char* data;
+        size_t bytes;
+        const uint64_t* offsets;
+        const char* names;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "hot_row_replicas.h"
+
+std::vector<long> top_rows(const std::vector<double>& degrees, long count) {
+    std::vector<long> rows(degrees.size());
+    for (long index=0; index<(long)degrees.size(); index++)
+        rows[index] = index;
+    if (count > (long)rows.size())
+        count = rows.size();
+    std::partial_sort(rows.begin(), rows.begin()+count, rows.end(),
+                      [&degrees](long a, long b) { return degrees[a] > degrees[b]; });
+    rows.resize(count);
+    return rows;
+}
+
+std::vector<int> row_slots(long size, const std::vector<long>& rows) {
+    std::vector<int> slots(size, -1);
+    for (int slot=0; slot<(int)rows.size(); slot++)
+        slots[rows[slot]] = slot;
+    return slots;
+}
+
+template<typename T>
+HotRowReplicas<T>::HotRowReplicas(LookupMapper<T>* mapper, const std::vector<long>& rows, const std::vector<int>& slots) {
+    this->mapper = mapper;
+    this->rows = &rows;
+    this->slots = &slots;
+    this->stride = mapper->stride;
+    // allocated by the worker that owns them, so they are local to its node
+    this->replicas = (T*)allocate_aligned(this->bytes(), 0);
+    this->bases = (T*)allocate_aligned(this->bytes(), 0);
+    for (size_t slot=0; slot<rows.size(); slot++)
+    {
+        memcpy(this->replicas + slot*this->stride, mapper->row(rows[slot]), sizeof(T)*this->stride);
+        memcpy(this->bases + slot*this->stride, mapper->row(rows[slot]), sizeof(T)*this->stride);
+    }
+}
+
+template<typename T>
+HotRowReplicas<T>::~HotRowReplicas() {
+    release_aligned(this->replicas, this->bytes(), 0);
+    release_aligned(this->bases, this->bytes(), 0);
+}
+
+template<typename T>
+void HotRowReplicas<T>::merge() {
+    const int dimension = this->mapper->dimension;
+    const long state_offset = this->mapper->state_offset, state_size = this->mapper->state_size;
+    for (size_t slot=0; slot<this->rows->size(); slot++)
+    {
+        T* master = this->mapper->row((*this->rows)[slot]);
+        T* replica = this->replicas + slot*this->stride;
+        T* base = this->bases + slot*this->stride;
+        if (this->mapper->dirty_rows)
+            this->mapper->dirty_rows->touch((*this->rows)[slot], master);
+        // table += replica - base, Hogwild-style like any other update
+        for (int d=0; d<dimension; d++)
+            master[d] = StorageTraits<T>::store_stochastic(StorageTraits<T>::load(master[d])
+                      + StorageTraits<T>::load(replica[d]) - StorageTraits<T>::load(base[d]));
+        real* master_state = (real*)(master + state_offset);
+        real* replica_state = (real*)(replica + state_offset);
+        real* base_state = (real*)(base + state_offset);
+        for (long d=0; d<state_size; d++)
+            master_state[d] += replica_state[d] - base_state[d];
+        memcpy(replica, master, sizeof(T)*this->stride);
+        memcpy(base, master, sizeof(T)*this->stride);
+    }
+}
+
+template class HotRowReplicas<double>;
+template class HotRowReplicas<float>;
+template class HotRowReplicas<bfloat16>;
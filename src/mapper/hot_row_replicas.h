@@ -0,0 +1,58 @@
+#ifndef HOT_ROW_REPLICAS_H
+#define HOT_ROW_REPLICAS_H
+#include <vector>
+#include "lookup_mapper.h"
+
+#define HOT_ROW_MERGE 1000
+
+// the count rows of largest degree, hottest first
+std::vector<long> top_rows(const std::vector<double>& degrees, long count);
+// row -> its position in rows, -1 for every other row
+std::vector<int> row_slots(long size, const std::vector<long>& rows);
+
+template<typename T>
+class HotRowReplicas {
+    /* HotRowReplicas gives one worker private copies of the hottest rows of
+     * a LookupMapper, optimizer state included, so that the rows every
+     * worker updates stop bouncing between cores. merge() adds what the
+     * worker changed since the last merge to the table and takes the table's
+     * rows back, which carries the other workers' changes in; cold rows are
+     * read and updated in the table directly.
+     * `slots` (see row_slots) is shared by all the workers' replicas.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        LookupMapper<T>* mapper;
+        const std::vector<long>* rows;
+        const std::vector<int>* slots;
+        long stride;
+        // the replicas, and the table's rows as they were at the last merge
+        T* replicas;
+        T* bases;
+
+        // constructor
+        HotRowReplicas(LookupMapper<T>* mapper, const std::vector<long>& rows, const std::vector<int>& slots);
+        ~HotRowReplicas();
+        HotRowReplicas(const HotRowReplicas&) = delete;
+        HotRowReplicas& operator=(const HotRowReplicas&) = delete;
+
+        T* row(long index) {
+            int slot = (*this->slots)[index];
+            return slot < 0 ? this->mapper->row(index) : this->replicas + slot*this->stride;
+        }
+        template<int DIM>
+        void update_with_l2(long index, const real* loss_vector, real alpha, real lambda) {
+            int slot = (*this->slots)[index];
+            if (slot < 0)
+                this->mapper->template update_with_l2<DIM>(index, loss_vector, alpha, lambda);
+            else
+                this->mapper->template update_row_with_l2<DIM>(this->replicas + slot*this->stride, loss_vector, alpha, lambda);
+        }
+        void merge();
+
+    private:
+        size_t bytes() { return sizeof(T)*this->rows->size()*this->stride; }
+};
+#endif
@@ -1,49 +1,267 @@
+#include <omp.h>
+#include <stdexcept>
 #include "lookup_mapper.h"
 
-LookupMapper::LookupMapper(int size, int dimension) {
-    this->embedding.resize(size);
+int parse_update_rule(std::string name) {
+    if (name == "sgd")
+        return UPDATE_SGD;
+    if (name == "adagrad")
+        return UPDATE_ADAGRAD;
+    if (name == "adam")
+        return UPDATE_ADAM;
+    return -1;
+}
+
+template<typename T>
+LookupMapper<T>::LookupMapper(int size, int dimension) {
+    this->init(size, dimension, 0, UPDATE_SGD, "", ADVICE_NORMAL);
+}
+
+template<typename T>
+LookupMapper<T>::LookupMapper(int size, int dimension, int huge_page) {
+    this->init(size, dimension, huge_page, UPDATE_SGD, "", ADVICE_NORMAL);
+}
+
+template<typename T>
+LookupMapper<T>::LookupMapper(int size, int dimension, int huge_page, int update_rule) {
+    this->init(size, dimension, huge_page, update_rule, "", ADVICE_NORMAL);
+}
+
+template<typename T>
+LookupMapper<T>::LookupMapper(int size, int dimension, int huge_page, int update_rule, std::string table_file, int advice) {
+    this->init(size, dimension, huge_page, update_rule, table_file, advice);
+}
+
+template<typename T>
+LookupMapper<T>::~LookupMapper() {
+    if (this->table)
+        unmap_file(this->table, this->table_header(0).dictionary_offset);
+    else if (!this->attached)
+        release_aligned(this->embedding, this->bytes(), this->huge_page);
+}
+
+template<typename T>
+EmbeddingFileHeader LookupMapper<T>::table_header(size_t name_bytes) {
+    return make_embedding_file_header(StorageTraits<T>::precision(), this->size, this->dimension, sizeof(T)*this->stride, name_bytes);
+}
+
+template<typename T>
+void LookupMapper<T>::init(int size, int dimension, int huge_page, int update_rule, std::string table_file, int advice) {
     this->size = size;
     this->dimension = dimension;
+    this->huge_page = huge_page;
+    this->update_rule = update_rule;
+    this->table_file = table_file;
+    this->table = NULL;
+    this->attached = 0;
+    this->dirty_rows = NULL;
+
+    // [embedding | padding | optimizer state | padding]
+    this->state_size = 0;
+    if (update_rule == UPDATE_ADAGRAD)
+        this->state_size = dimension;
+    else if (update_rule == UPDATE_ADAM)
+        this->state_size = 2*dimension + 1;
+    this->state_offset = align_size(sizeof(T)*dimension, CACHE_LINE_SIZE)/sizeof(T);
+    this->stride = this->state_offset + align_size(sizeof(real)*this->state_size, CACHE_LINE_SIZE)/sizeof(T);
+    if (table_file.empty())
+        this->embedding = (T*)allocate_aligned(this->bytes(), huge_page);
+    else
+    {
+        // [header page | rows] of a binary embedding file, dictionary added by save_table()
+        EmbeddingFileHeader header = this->table_header(0);
+        this->table = (char*)map_file(table_file, header.dictionary_offset, advice);
+        memcpy(this->table, &header, sizeof(header));
+        this->embedding = (T*)(this->table + header.matrix_offset);
+        std::cout << "Embedding Table: <" << table_file << ">" << std::endl;
+    }
+
+    // rows are first touched by the threads that initialize them; each row owns
+    // a disjoint range of random states so the result does not depend on threads
+    #pragma omp parallel for schedule(static)
     for (long index=0; index<size; ++index)
     {
-        this->embedding[index].resize(dimension);
+        T* row = this->row(index);
+        unsigned long long state = LOOKUP_MAPPER_SEED + index*dimension*0x9E3779B97F4A7C15ULL;
         for (int d=0; d<dimension; ++d)
         {
-            this->embedding[index][d] = (rand()/(double)RAND_MAX - 0.5) / dimension;
+            row[d] = StorageTraits<T>::store((seeded_uniform(&state) - 0.5) / dimension);
+        }
+        for (int d=dimension; d<this->stride; ++d)
+        {
+            row[d] = StorageTraits<T>::store(0.0);
+        }
+        if (update_rule == UPDATE_ADAGRAD)
+        {
+            real* state = this->state(index);
+            for (int d=0; d<dimension; ++d)
+                state[d] = ADAGRAD_INIT_ACCUMULATOR;
         }
     }
 }
 
-void LookupMapper::update(long index, std::vector<double>& loss_vector, double alpha) {
-    for (int d=0; d<this->dimension; d++)
+template<typename T>
+void LookupMapper<T>::update(long index, std::vector<real>& loss_vector, real alpha) {
+    if (this->dirty_rows)
+        this->dirty_rows->touch(index, this->row(index));
+    vk_axpy(alpha, loss_vector.data(), this->row(index), this->dimension);
+}
+
+template<typename T>
+void LookupMapper<T>::update_with_l2(long index, std::vector<real>& loss_vector, real alpha, real lambda) {
+    this->update_with_l2<0>(index, loss_vector.data(), alpha, lambda);
+}
+
+template<typename T>
+long LookupMapper<T>::load_from_file(FileGraph* file_graph, std::string file_name) {
+    std::cout << "Warm Start Mapper:" << std::endl;
+    FILE* embedding_file = fopen(file_name.c_str(), "rb");
+    if (!embedding_file)
+        throw std::runtime_error("fail to open file " + file_name);
+    char magic[sizeof(EMBEDDING_FILE_MAGIC)-1] = {0};
+    size_t magic_size = fread(magic, 1, sizeof(magic), embedding_file);
+    long matched = 0, rows = 0;
+
+    if (magic_size == sizeof(magic) && !memcmp(magic, EMBEDDING_FILE_MAGIC, sizeof(magic)))
     {
-        this->embedding[index][d] += alpha*loss_vector[d];
+        fclose(embedding_file);
+        EmbeddingFile binary(file_name);
+        if (binary.dimension != this->dimension)
+            throw std::runtime_error("dimension " + std::to_string(binary.dimension) + " of " + file_name + " does not match " + std::to_string(this->dimension));
+        rows = binary.rows;
+        #pragma omp parallel for schedule(dynamic, 1024) reduction(+:matched)
+        for (long r=0; r<rows; r++)
+        {
+            long index = file_graph->node2index.search_key((char*)binary.name(r));
+            if (index < 0 || index >= this->size)
+                continue;
+            T* row = this->row(index);
+            for (int d=0; d<this->dimension; d++)
+                row[d] = StorageTraits<T>::store(binary.get(r, d));
+            matched++;
+        }
     }
+    else
+    {
+        // read the whole file, then parse its lines in parallel:
+        // name, then dimension values separated by spaces or tabs
+        fseek(embedding_file, 0, SEEK_END);
+        long bytes = ftell(embedding_file);
+        fseek(embedding_file, 0, SEEK_SET);
+        std::vector<char> text(bytes+1, '\0');
+        if (fread(text.data(), 1, bytes, embedding_file) != (size_t)bytes)
+        {
+            fclose(embedding_file);
+            throw std::runtime_error("fail to read file " + file_name);
+        }
+        fclose(embedding_file);
+        std::vector<char*> lines;
+        if (bytes)
+            lines.push_back(text.data());
+        for (long offset=0; offset<bytes; offset++)
+        {
+            if (text[offset] != '\n')
+                continue;
+            text[offset] = '\0';
+            if (offset+1 < bytes)
+                lines.push_back(text.data()+offset+1);
+        }
+        rows = lines.size();
+
+        long malformed = 0;
+        #pragma omp parallel reduction(+:matched, malformed)
+        {
+            // values are staged so that a short line leaves the row untouched
+            std::vector<real> parsed(this->dimension);
+            #pragma omp for schedule(dynamic, 1024)
+            for (long r=0; r<rows; r++)
+            {
+                char* name = lines[r];
+                char* cursor = name + strcspn(name, " \t");
+                if (*cursor == '\0')
+                {
+                    malformed++;
+                    continue;
+                }
+                *cursor++ = '\0';
+                long index = file_graph->node2index.search_key(name);
+                if (index < 0 || index >= this->size)
+                    continue;
+                int d = 0;
+                for (; d<this->dimension; d++)
+                {
+                    char* end;
+                    parsed[d] = strtod(cursor, &end);
+                    if (end == cursor)
+                        break;
+                    cursor = end;
+                }
+                cursor += strspn(cursor, " \t\r");
+                if (d != this->dimension || *cursor != '\0')
+                {
+                    malformed++;
+                    continue;
+                }
+                T* row = this->row(index);
+                for (d=0; d<this->dimension; d++)
+                    row[d] = StorageTraits<T>::store(parsed[d]);
+                matched++;
+            }
+        }
+        if (malformed)
+            std::cout << "\t[WARNING] skip " << malformed << " lines without " << this->dimension << " values" << std::endl;
+    }
+    std::cout << "\t" << matched << " of " << rows << " rows matched, " << this->size-matched << " rows left random <" << file_name << ">" << std::endl;
+    return matched;
 }
 
-void LookupMapper::update_with_l2(long index, std::vector<double>& loss_vector, double alpha, double lambda) {
-    for (int d=0; d<this->dimension; d++)
+template<typename T>
+void LookupMapper<T>::write_text_rows(FILE* file, std::vector<char*>& index2node, const long* indexes, long count, const real* fused, char separator) {
+    // every thread formats a block of rows into its own buffer, then the
+    // blocks are written in order with one fwrite each; values are written as
+    // the shortest text that reads back to the same float32
+    int threads = omp_get_max_threads();
+    std::vector<std::string> blocks(threads);
+    long group = (long)threads*LOOKUP_MAPPER_TEXT_BLOCK;
+    for (long offset=0; offset<count; offset+=group)
     {
-        this->embedding[index][d] += alpha*(loss_vector[d] - lambda*embedding[index][d]);
+        #pragma omp parallel for schedule(static, 1)
+        for (int b=0; b<threads; b++)
+        {
+            std::string& block = blocks[b];
+            char number[32];
+            long begin = offset + (long)b*LOOKUP_MAPPER_TEXT_BLOCK;
+            long end = begin + LOOKUP_MAPPER_TEXT_BLOCK < count ? begin + LOOKUP_MAPPER_TEXT_BLOCK : count;
+            block.clear();
+            for (long r=begin; r<end; r++)
+            {
+                block += index2node[indexes[r]];
+                for (int dim=0; dim!=this->dimension; dim++)
+                {
+                    real value = fused ? fused[r*this->dimension+dim] : this->get(indexes[r], dim);
+                    block += dim ? ' ' : separator;
+                    block.append(number, format_shortest((float)value, number));
+                }
+                block += '\n';
+            }
+        }
+        for (int b=0; b<threads; b++)
+            fwrite(blocks[b].data(), 1, blocks[b].size(), file);
     }
 }
 
-void LookupMapper::save_to_file(std::vector<char*>& index2node, std::string file_name) {
+template<typename T>
+void LookupMapper<T>::save_to_file(std::vector<char*>& index2node, std::string file_name) {
     std::cout << "Save Mapper:" << std::endl;
-    std::ofstream embedding_file(file_name);
+    FILE* embedding_file = fopen(file_name.c_str(), "w");
     if (embedding_file)
     {
         //embedding_file << this->size << " " << this->dimension << std::endl;
+        std::vector<long> indexes(this->size);
         for (long index=0; index!=this->size; index++)
-        {
-            embedding_file << index2node[index];
-            embedding_file << " " << embedding[index][0];
-            for (int dim=1; dim!=this->dimension; dim++)
-            {
-                embedding_file << " " << this->embedding[index][dim];
-            }
-            embedding_file << std::endl;
-        }
+            indexes[index] = index;
+        this->write_text_rows(embedding_file, index2node, indexes.data(), indexes.size(), NULL, ' ');
+        fclose(embedding_file);
         std::cout << "\tSave to <" << file_name << ">" << std::endl;
     }
     else
@@ -52,32 +270,25 @@ void LookupMapper::save_to_file(std::vector<char*>& index2node, std::string file
     }
 }
 
-void LookupMapper::save_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append) {
+template<typename T>
+void LookupMapper<T>::save_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append) {
     std::cout << "Save Mapper:" << std::endl;
-    std::ofstream embedding_file;
+    FILE* embedding_file;
     if (append)
     {
         std::cout << "Append Mapper:" << std::endl;
-        embedding_file.open(file_name, std::ios_base::app);
+        embedding_file = fopen(file_name.c_str(), "a");
     }
     else
     {
         std::cout << "Save Mapper:" << std::endl;
-        embedding_file.open(file_name);
+        embedding_file = fopen(file_name.c_str(), "w");
     }
 
     if (embedding_file)
     {
-        for (auto index: indexes)
-        {
-            embedding_file << file_graph->index2node[index];
-            embedding_file << " " << embedding[index][0];
-            for (int dim=1; dim!=this->dimension; dim++)
-            {
-                embedding_file << " " << this->embedding[index][dim];
-            }
-            embedding_file << std::endl;
-        }
+        this->write_text_rows(embedding_file, file_graph->index2node, indexes.data(), indexes.size(), NULL, ' ');
+        fclose(embedding_file);
         std::cout << "\tSave to <" << file_name << ">" << std::endl;
     }
     else
@@ -86,47 +297,112 @@ void LookupMapper::save_to_file(FileGraph* file_graph, std::vector<long> indexes
     }
 }
 
+template<typename T>
+int LookupMapper<T>::save_to_binary(FileGraph* file_graph, std::vector<long>& indexes, std::string file_name) {
+    std::cout << "Save Binary Mapper:" << std::endl;
+    FILE* embedding_file = fopen(file_name.c_str(), "wb");
+    if (!embedding_file)
+    {
+        std::cout << "\tfail to open file" << std::endl;
+        return 0;
+    }
 
-void LookupMapper::save_trans_to_file(FileGraph* file_graph, std::string file_name) {
-    std::cout << "Save Mapper:" << std::endl;
-    std::vector<double> fused_embedding(this->dimension, 0.0);
-    long branch, from_index, to_index;
-    std::ofstream embedding_file(file_name);
-    if (embedding_file)
+    long rows = indexes.size();
+    std::vector<const char*> names(rows);
+    for (long r=0; r<rows; r++)
+        names[r] = file_graph->index2node[indexes[r]];
+    std::vector<uint64_t> offsets = dictionary_offsets(names);
+    EmbeddingFileHeader header = make_embedding_file_header(StorageTraits<T>::precision(), rows, this->dimension, 0, offsets[rows]);
+
+    // header page
+    std::vector<char> page(header.matrix_offset, 0);
+    memcpy(page.data(), &header, sizeof(header));
+    fwrite(page.data(), 1, page.size(), embedding_file);
+
+    // matrix, in blocks of padded rows
+    std::vector<char> block(header.row_stride_bytes*LOOKUP_MAPPER_TEXT_BLOCK, 0);
+    for (long offset=0; offset<rows; offset+=LOOKUP_MAPPER_TEXT_BLOCK)
+    {
+        long count = rows-offset < LOOKUP_MAPPER_TEXT_BLOCK ? rows-offset : LOOKUP_MAPPER_TEXT_BLOCK;
+        for (long r=0; r<count; r++)
+            memcpy(block.data() + r*header.row_stride_bytes, this->row(indexes[offset+r]), sizeof(T)*this->dimension);
+        fwrite(block.data(), 1, count*header.row_stride_bytes, embedding_file);
+    }
+    page.assign(header.dictionary_offset - header.matrix_offset - rows*header.row_stride_bytes, 0);
+    fwrite(page.data(), 1, page.size(), embedding_file);
+
+    write_dictionary(embedding_file, names, offsets);
+    if (!ferror(embedding_file) && fclose(embedding_file) == 0)
     {
-        for (from_index=0; from_index<file_graph->index2node.size(); from_index++)
+        std::cout << "\tSave to <" << file_name << ">" << std::endl;
+        return 1;
+    }
+    std::cout << "\tfail to write file" << std::endl;
+    return 0;
+}
+
+template<typename T>
+void LookupMapper<T>::fuse_neighbors(CSRGraph& csr, const long* indexes, long count, real self_scale, real neighbor_scale, int weighted, real* fused) {
+    // fused = self_scale*E[from] + neighbor_scale*(A[from]*E)/sum(A[from]), one
+    // row of the sparse x dense product per iteration; rows without
+    // neighbors keep their own embedding
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (long r=0; r<count; r++)
+    {
+        long from_index = indexes[r];
+        real* out = fused + r*this->dimension;
+        T* self = this->row(from_index);
+        long begin = csr.offsets[from_index], end = csr.offsets[from_index+1];
+        if (begin == end)
         {
-            branch = file_graph->index_graph[from_index].size();
-            embedding_file << file_graph->index2node[from_index];
-            if (branch > 0)
-            {
-                fused_embedding.assign(this->dimension, 0.0);
-                for (auto it: file_graph->index_graph[from_index])
-                {
-                    to_index = it.first;
-                    for (int dim=0; dim!=this->dimension; dim++)
-                    {
-                        fused_embedding[dim] += this->embedding[from_index][dim];
-                        fused_embedding[dim] += this->embedding[to_index][dim];
-                    }
-                }
-                embedding_file << "\t" << fused_embedding[0]/branch;
-                for (int dim=1; dim!=this->dimension; dim++)
-                {
-                    embedding_file << " " << fused_embedding[dim]/branch;
-                }
-                embedding_file << std::endl;
-            }
-            else
-            {
-                embedding_file << "\t" << embedding[from_index][0];
-                for (int dim=1; dim!=this->dimension; dim++)
-                {
-                    embedding_file << " " << this->embedding[from_index][dim];
-                }
-                embedding_file << std::endl;
-            }
+            for (int d=0; d<this->dimension; d++)
+                out[d] = StorageTraits<T>::load(self[d]);
+            continue;
         }
+        for (int d=0; d<this->dimension; d++)
+            out[d] = 0.0;
+        double weight_sum = 0.0;
+        for (long k=begin; k<end; k++)
+        {
+            real weight = weighted ? csr.weights[k] : 1.0;
+            T* neighbor = this->row(csr.columns[k]);
+            weight_sum += weight;
+            for (int d=0; d<this->dimension; d++)
+                out[d] += weight*StorageTraits<T>::load(neighbor[d]);
+        }
+        real scale = neighbor_scale/weight_sum;
+        for (int d=0; d<this->dimension; d++)
+            out[d] = self_scale*StorageTraits<T>::load(self[d]) + scale*out[d];
+    }
+}
+
+template<typename T>
+void LookupMapper<T>::save_fused_to_file(FileGraph* file_graph, std::vector<long>& indexes, FILE* embedding_file, real self_scale, real neighbor_scale, int weighted) {
+    // aggregate a group of rows into the fused table, then write it
+    CSRGraph csr = file_graph->build_csr();
+    long group = (long)omp_get_max_threads()*LOOKUP_MAPPER_TEXT_BLOCK;
+    std::vector<real> fused(group*this->dimension);
+    long rows = indexes.size();
+    for (long offset=0; offset<rows; offset+=group)
+    {
+        long count = rows-offset < group ? rows-offset : group;
+        this->fuse_neighbors(csr, indexes.data()+offset, count, self_scale, neighbor_scale, weighted, fused.data());
+        this->write_text_rows(embedding_file, file_graph->index2node, indexes.data()+offset, count, fused.data(), '\t');
+    }
+}
+
+template<typename T>
+void LookupMapper<T>::save_trans_to_file(FileGraph* file_graph, std::string file_name) {
+    std::cout << "Save Mapper:" << std::endl;
+    FILE* embedding_file = fopen(file_name.c_str(), "w");
+    if (embedding_file)
+    {
+        // E[from] + mean of E[to]
+        std::vector<long> indexes(file_graph->index2node.size());
+        for (long index=0; index<(long)indexes.size(); index++)
+            indexes[index] = index;
+        this->save_fused_to_file(file_graph, indexes, embedding_file, 1.0, 1.0, 0);
+        fclose(embedding_file);
         std::cout << "\tSave to <" << file_name << ">" << std::endl;
     }
     else
@@ -135,100 +411,220 @@ void LookupMapper::save_trans_to_file(FileGraph* file_graph, std::string file_na
     }
 }
 
-void LookupMapper::save_gcn_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append) {
-    std::vector<double> fused_embedding(this->dimension, 0.0);
-    long branch, from_index, to_index;
-    double weight, weight_sum;
-    std::ofstream embedding_file;
+template<typename T>
+void LookupMapper<T>::save_gcn_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append) {
+    FILE* embedding_file;
     if (append)
     {
         std::cout << "Append Mapper:" << std::endl;
-        embedding_file.open(file_name, std::ios_base::app);
+        embedding_file = fopen(file_name.c_str(), "a");
     }
     else
     {
         std::cout << "Save Mapper:" << std::endl;
-        embedding_file.open(file_name);
+        embedding_file = fopen(file_name.c_str(), "w");
     }
 
     if (embedding_file)
     {
-        for (auto from_index: indexes)
-        {
-            branch = file_graph->index_graph[from_index].size();
-            if (branch > 0)
-            {
-                embedding_file << file_graph->index2node[from_index];
-                fused_embedding.assign(this->dimension, 0.0);
-                weight_sum = 0.0;
-                for (auto it: file_graph->index_graph[from_index])
-                {
-                    to_index = it.first;
-                    weight = file_graph->index_graph[from_index][to_index];
-                    weight_sum += weight;
-                    for (int dim=0; dim!=this->dimension; dim++)
-                    {
-                        fused_embedding[dim] += this->embedding[to_index][dim]*weight;
-                    }
-                }
-                embedding_file << "\t" << (this->embedding[from_index][0]+fused_embedding[0]/weight_sum)/2.0;
-                for (int dim=1; dim!=this->dimension; dim++)
-                {
-                    embedding_file << " " << (this->embedding[from_index][dim]+fused_embedding[dim]/weight_sum)/2.0;
-                }
-                embedding_file << std::endl;
-            }
-            else
-            {
-                embedding_file << file_graph->index2node[from_index];
-                embedding_file << "\t" << this->embedding[from_index][0];
-                for (int dim=1; dim!=this->dimension; dim++)
-                {
-                    embedding_file << " " << this->embedding[from_index][dim];
-                }
-                embedding_file << std::endl;
-            }
-        }
+        // (E[from] + weighted mean of E[to])/2
+        this->save_fused_to_file(file_graph, indexes, embedding_file, 0.5, 0.5, 1);
+        fclose(embedding_file);
         std::cout << "\tSave to <" << file_name << ">" << std::endl;
     }
     else
     {
         std::cout << "\tfail to open file" << std::endl;
     }
-    embedding_file.close();
 }
 
 
-std::vector<double>& LookupMapper::operator[](long index) {
-    return this->embedding[index];
+template<typename T>
+void LookupMapper<T>::gather_float_rows(const long* indexes, long count, float* matrix) {
+    #pragma omp parallel for schedule(static)
+    for (long r=0; r<count; r++)
+        for (int d=0; d<this->dimension; d++)
+            matrix[r*this->dimension+d] = this->get(indexes[r], d);
 }
 
-std::vector<double> LookupMapper::avg_embedding(std::vector<long>& indexes) {
-    std::vector<double> avg_embedding(this->dimension, 0.0);
-    for (auto index: indexes)
-        for (int d=0; d<this->dimension; d++)
-            avg_embedding[d] += this->embedding[index][d];
+template<typename T>
+int LookupMapper<T>::save_to_quantized(FileGraph* file_graph, std::vector<long>& indexes, std::string file_name, int kind, int subspaces) {
+    std::cout << "Save Quantized Mapper:" << std::endl;
+    if (kind == QUANTIZE_PQ && (subspaces <= 0 || this->dimension % subspaces))
+    {
+        std::cout << "\tdimension " << this->dimension << " is not divisible into " << subspaces << " sub-spaces" << std::endl;
+        return 0;
+    }
+    FILE* embedding_file = fopen(file_name.c_str(), "wb");
+    if (!embedding_file)
+    {
+        std::cout << "\tfail to open file" << std::endl;
+        return 0;
+    }
+
+    long rows = indexes.size();
+    std::vector<const char*> names(rows);
+    for (long r=0; r<rows; r++)
+        names[r] = file_graph->index2node[indexes[r]];
+    std::vector<uint64_t> offsets = dictionary_offsets(names);
+    QuantizedHeader header = make_quantized_header(kind, rows, this->dimension, subspaces, offsets[rows]);
+
+    // header page, then the codebooks trained on evenly spaced rows
+    std::vector<char> page(header.codebook_offset, 0);
+    memcpy(page.data(), &header, sizeof(header));
+    fwrite(page.data(), 1, page.size(), embedding_file);
+    std::vector<float> codebook;
+    if (kind == QUANTIZE_PQ && rows)
+    {
+        long sample_rows = rows < PQ_TRAIN_ROWS ? rows : PQ_TRAIN_ROWS;
+        std::vector<long> sample_indexes(sample_rows);
+        for (long r=0; r<sample_rows; r++)
+            sample_indexes[r] = indexes[r*rows/sample_rows];
+        std::vector<float> sample(sample_rows*this->dimension);
+        this->gather_float_rows(sample_indexes.data(), sample_rows, sample.data());
+        codebook.resize((long)PQ_CENTROIDS*this->dimension);
+        train_product_quantizer(sample.data(), sample_rows, this->dimension, subspaces, codebook.data());
+        page.assign(header.codes_offset-header.codebook_offset, 0);
+        memcpy(page.data(), codebook.data(), sizeof(float)*codebook.size());
+        fwrite(page.data(), 1, page.size(), embedding_file);
+    }
+
+    // codes, in blocks of rows
+    std::vector<float> matrix((long)LOOKUP_MAPPER_TEXT_BLOCK*this->dimension);
+    std::vector<char> codes(LOOKUP_MAPPER_TEXT_BLOCK*header.code_bytes);
+    for (long offset=0; offset<rows; offset+=LOOKUP_MAPPER_TEXT_BLOCK)
+    {
+        long count = rows-offset < LOOKUP_MAPPER_TEXT_BLOCK ? rows-offset : LOOKUP_MAPPER_TEXT_BLOCK;
+        this->gather_float_rows(indexes.data()+offset, count, matrix.data());
+        quantize_rows(header, codebook.data(), matrix.data(), count, codes.data());
+        fwrite(codes.data(), 1, count*header.code_bytes, embedding_file);
+    }
+    page.assign(header.dictionary_offset - header.codes_offset - rows*header.code_bytes, 0);
+    fwrite(page.data(), 1, page.size(), embedding_file);
+
+    write_dictionary(embedding_file, names, offsets);
+    if (!ferror(embedding_file) && fclose(embedding_file) == 0)
+    {
+        std::cout << "\tSave to <" << file_name << ">" << std::endl;
+        return 1;
+    }
+    std::cout << "\tfail to write file" << std::endl;
+    return 0;
+}
+
+template<typename T>
+void LookupMapper<T>::sync(int wait) {
+    if (this->table)
+        sync_file(this->table, this->table_header(0).dictionary_offset, wait);
+}
+
+template<typename T>
+void LookupMapper<T>::attach(T* buffer, int copy) {
+    if (this->table)
+    {
+        std::cout << "a file-backed mapper cannot be attached" << std::endl;
+        exit(1);
+    }
+    if (copy)
+        memcpy(buffer, this->embedding, this->bytes());
+    if (!this->attached)
+        release_aligned(this->embedding, this->bytes(), this->huge_page);
+    this->embedding = buffer;
+    this->attached = 1;
+}
+
+template<typename T>
+void LookupMapper<T>::save_table(FileGraph* file_graph) {
+    std::cout << "Save Embedding Table:" << std::endl;
+    if (!this->table)
+    {
+        std::cout << "\tthe mapper is not file-backed" << std::endl;
+        return;
+    }
+
+    // row r is named index2node[r]; rows beyond the dictionary stay unnamed
+    std::vector<const char*> names(this->size, "");
+    for (long index=0; index<this->size && index<(long)file_graph->index2node.size(); index++)
+        names[index] = file_graph->index2node[index];
+    std::vector<uint64_t> offsets = dictionary_offsets(names);
+    EmbeddingFileHeader header = this->table_header(offsets[this->size]);
+
+    // dictionary past the mapping, then the header, then everything to disk
+    FILE* embedding_file = fopen(this->table_file.c_str(), "r+b");
+    int written = embedding_file && fseek(embedding_file, header.dictionary_offset, SEEK_SET) == 0;
+    if (written)
+        write_dictionary(embedding_file, names, offsets);
+    if (embedding_file && (ferror(embedding_file) | fclose(embedding_file)))
+        written = 0;
+    if (!written)
+    {
+        std::cout << "\tfail to write file" << std::endl;
+        return;
+    }
+    memcpy(this->table, &header, sizeof(header));
+    this->sync(1);
+    std::cout << "\tSave to <" << this->table_file << ">" << std::endl;
+}
+
+template<typename T>
+EmbeddingRow<T> LookupMapper<T>::operator[](long index) {
+    return EmbeddingRow<T>(this->row(index), this->dimension);
+}
+
+template<typename T>
+void LookupMapper<T>::sum_rows(const long* indexes, int count, real scale, real* out) {
+    // out = scale * sum of the rows, gathered in batches of row pointers
+    const T* rows[LOOKUP_MAPPER_ROW_BATCH];
+    int batch = count < LOOKUP_MAPPER_ROW_BATCH ? count : LOOKUP_MAPPER_ROW_BATCH;
+    for (int r=0; r<batch; r++)
+        rows[r] = this->row(indexes[r]);
+    vk_sum_rows(rows, batch, scale, out, this->dimension);
+    if (count <= LOOKUP_MAPPER_ROW_BATCH)
+        return;
+
+    std::vector<real> partial(this->dimension);
+    for (int offset=batch; offset<count; offset+=batch)
+    {
+        batch = count-offset < LOOKUP_MAPPER_ROW_BATCH ? count-offset : LOOKUP_MAPPER_ROW_BATCH;
+        for (int r=0; r<batch; r++)
+            rows[r] = this->row(indexes[offset+r]);
+        vk_sum_rows(rows, batch, scale, partial.data(), this->dimension);
+        vk_axpy((real)1.0, partial.data(), out, this->dimension);
+    }
+}
+
+template<typename T>
+std::vector<typename LookupMapper<T>::real> LookupMapper<T>::avg_embedding(std::vector<long>& indexes) {
+    std::vector<real> avg_embedding(this->dimension, 0.0);
+    if (indexes.size())
+        this->sum_rows(indexes.data(), indexes.size(), 1.0, avg_embedding.data());
     return avg_embedding;
 }
 
-std::vector<double> LookupMapper::textgcn_embedding(std::vector<long>& indexes) {
-    std::vector<double> avg_embedding(this->dimension, 0.0);
-    double size = indexes.size()-1;
-    if (size)
+template<typename T>
+std::vector<typename LookupMapper<T>::real> LookupMapper<T>::textgcn_embedding(std::vector<long>& indexes) {
+    std::vector<real> avg_embedding(this->dimension, 0.0);
+    long size = indexes.size()-1;
+    if (size == 1)
     {
-        for (auto it=++indexes.begin(); it!=indexes.end(); it++)
-            for (int d=0; d<this->dimension; d++)
-                avg_embedding[d] += this->embedding[*(it)][d];
-        for (int d=0; d<this->dimension; d++)
-        {
-            avg_embedding[d] = (this->embedding[indexes[0]][d] + avg_embedding[d]/size)/2.0;
-        }
+        // (self + word)/2
+        this->sum_rows(indexes.data(), 2, 0.5, avg_embedding.data());
     }
-    else{
+    else if (size)
+    {
+        // (self + mean of words)/2
+        T* row = this->row(indexes[0]);
+        this->sum_rows(indexes.data()+1, size, 0.5/size, avg_embedding.data());
         for (int d=0; d<this->dimension; d++)
-            avg_embedding[d] += this->embedding[indexes[0]][d];
+            avg_embedding[d] += 0.5*StorageTraits<T>::load(row[d]);
+    }
+    else
+    {
+        this->sum_rows(indexes.data(), 1, 1.0, avg_embedding.data());
     }
     return avg_embedding;
 }
 
-
+template class LookupMapper<double>;
+template class LookupMapper<float>;
+template class LookupMapper<bfloat16>;
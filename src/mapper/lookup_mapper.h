@@ -7,31 +7,171 @@
 #include <unordered_map>
 #include <vector>
 #include "../util/file_graph.h"
+#include "../util/util.h"
+#include "../util/memory.h"
+#include "../util/precision.h"
+#include "../util/random.h"
+#include "../util/vector_kernels.h"
+#include "dirty_rows.h"
+#include "embedding_file.h"
+#include "quantized_embedding.h"
 
+#define LOOKUP_MAPPER_SEED 0x5EEDULL
+#define LOOKUP_MAPPER_ROW_BATCH 16
+#define LOOKUP_MAPPER_TEXT_BLOCK 4096
+
+// update rules
+#define UPDATE_SGD 0
+#define UPDATE_ADAGRAD 1
+#define UPDATE_ADAM 2
+#define ADAGRAD_INIT_ACCUMULATOR 0.1
+
+// "sgd" / "adagrad" / "adam" -> UPDATE_*, -1 if unknown
+int parse_update_rule(std::string name);
+
+template<typename T>
+class EmbeddingRow {
+    /* EmbeddingRow is a lightweight view of one row in the embedding table.
+     */
+    public:
+        T* data;
+        int dimension;
+
+        EmbeddingRow(T* data, int dimension) : data(data), dimension(dimension) {}
+        T& operator[](int d) { return this->data[d]; }
+        typename StorageTraits<T>::real get(int d) { return StorageTraits<T>::load(this->data[d]); }
+        int size() { return this->dimension; }
+};
+
+template<typename T>
 class LookupMapper {
+    /* LookupMapper keeps all the embeddings in one cache-line aligned, row-major
+     * buffer. Each row is padded to `stride` elements so that every row starts
+     * on a cache line. With an adaptive update rule, the row's optimizer state
+     * (in `real`) follows its embedding at `state_offset`, so an update touches
+     * neighbouring cache lines only and untouched rows pay nothing.
+     * The table is anonymous memory, or with a `table_file` a shared mapping
+     * laid out as a binary embedding file (see embedding_file.h): cold rows
+     * stay in the page cache and on disk, and save_table() only has to add
+     * the dictionary to make it the output.
+     * T is the storage type (double, float or bfloat16); the math runs in
+     * `real`, which is float32 for the reduced-precision types.
+     */
     public:
+        typedef typename StorageTraits<T>::real real;
+
         //variable
-        int size, dimension;
-        std::vector<std::vector<double>> embedding;
+        int size, dimension, huge_page, update_rule;
+        long stride, state_offset, state_size;
+        T* embedding;
+        std::string table_file;
+        char* table;
+        int attached;
+        // when set, told of every row before the update functions write it
+        DirtyRows* dirty_rows;
 
         // embedding function
-        std::vector<double> avg_embedding(std::vector<long>& indexes);
-        std::vector<double> textgcn_embedding(std::vector<long>& indexes);
+        std::vector<real> avg_embedding(std::vector<long>& indexes);
+        std::vector<real> textgcn_embedding(std::vector<long>& indexes);
 
         // constructor
         LookupMapper(int size, int dimension);
+        LookupMapper(int size, int dimension, int huge_page);
+        LookupMapper(int size, int dimension, int huge_page, int update_rule);
+        LookupMapper(int size, int dimension, int huge_page, int update_rule, std::string table_file, int advice);
+        ~LookupMapper();
+        LookupMapper(const LookupMapper&) = delete;
+        LookupMapper& operator=(const LookupMapper&) = delete;
 
         // update function
-        void update(long index, std::vector<double>& loss_vector, double alpha);
-        void update_with_l2(long index, std::vector<double>& loss_vector, double alpha, double lambda);
+        void update(long index, std::vector<real>& loss_vector, real alpha);
+        void update_with_l2(long index, std::vector<real>& loss_vector, real alpha, real lambda);
+
+        // dimension-specialized embedding / update into caller-owned buffers,
+        // DIM == 0 for any dimension
+        template<int DIM>
+        void textgcn_embedding(const long* indexes, int count, real* embedding) {
+            if (count == 2)
+                dim_sum2<DIM>(this->row(indexes[0]), this->row(indexes[1]), (real)0.5, embedding, this->dimension);
+            else if (count == 1)
+                dim_sum2<DIM>(this->row(indexes[0]), this->row(indexes[0]), (real)0.5, embedding, this->dimension);
+            else
+            {
+                // (self + mean of words)/2
+                this->sum_rows(indexes+1, count-1, 0.5/(count-1), embedding);
+                T* row = this->row(indexes[0]);
+                for (int d=0; d<(DIM ? DIM : this->dimension); d++)
+                    embedding[d] += 0.5*StorageTraits<T>::load(row[d]);
+            }
+        }
+        template<int DIM>
+        void update_with_l2(long index, const real* loss_vector, real alpha, real lambda) {
+            if (this->dirty_rows)
+                this->dirty_rows->touch(index, this->row(index));
+            this->template update_row_with_l2<DIM>(this->row(index), loss_vector, alpha, lambda);
+        }
+        // the same on a row laid out like the table's, e.g. a replica of one;
+        // dirty_rows is not told
+        template<int DIM>
+        void update_row_with_l2(T* row, const real* loss_vector, real alpha, real lambda) {
+            if (this->update_rule == UPDATE_ADAGRAD)
+                dim_adagrad_decay<DIM>(alpha, loss_vector, lambda, row, (real*)(row + this->state_offset), this->dimension);
+            else if (this->update_rule == UPDATE_ADAM)
+                dim_adam_decay<DIM>(alpha, loss_vector, lambda, row, (real*)(row + this->state_offset), this->dimension);
+            else
+                dim_axpy_decay<DIM>(alpha, loss_vector, lambda, row, this->dimension);
+        }
+
+        // load function: rows of a text or binary export whose names are in
+        // file_graph replace their initial values; returns how many matched,
+        // throws std::runtime_error if it cannot be read or its dimension differs
+        long load_from_file(FileGraph* file_graph, std::string file_name);
 
         // save function
         void save_to_file(std::vector<char*>& index2vertex, std::string file_name);
         void save_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append);
         void save_trans_to_file(FileGraph* file_graph, std::string file_name);
         void save_gcn_to_file(FileGraph* file_graph, std::vector<long> indexes, std::string file_name, int append);
+        // binary embedding file (see embedding_file.h), rows in the order of indexes;
+        // returns 0 when the file cannot be written
+        int save_to_binary(FileGraph* file_graph, std::vector<long>& indexes, std::string file_name);
+        // quantized embedding file (see quantized_embedding.h): QUANTIZE_INT8,
+        // or QUANTIZE_PQ with `subspaces` one-byte codes per row, which must
+        // divide the dimension; returns 0 when nothing was written
+        int save_to_quantized(FileGraph* file_graph, std::vector<long>& indexes, std::string file_name, int kind, int subspaces);
+        // file-backed table: flush dirty rows (wait = block until on disk), and
+        // finish the file as a binary export of all rows named by file_graph
+        void sync(int wait);
+        void save_table(FileGraph* file_graph);
+        // move the rows into `buffer` (bytes() bytes, e.g. shared memory owned
+        // by someone else) and use it from now on; copy = 0 adopts the rows
+        // buffer already holds
+        void attach(T* buffer, int copy);
+
+        // row access
+        T* row(long index) { return this->embedding + index*this->stride; }
+        real* state(long index) { return (real*)(this->row(index) + this->state_offset); }
+        real get(long index, int d) { return StorageTraits<T>::load(this->row(index)[d]); }
+        // L2 norm of the embedding of a row laid out like the table's
+        real norm(const T* row) {
+            real sum = 0;
+            for (int d=0; d<this->dimension; d++)
+                sum += StorageTraits<T>::load(row[d])*StorageTraits<T>::load(row[d]);
+            return std::sqrt(sum);
+        }
+        size_t bytes() { return sizeof(T)*this->size*this->stride; }
 
         // overload operator
-        std::vector<double>& operator[](long index);
+        EmbeddingRow<T> operator[](long index);
+
+    private:
+        void init(int size, int dimension, int huge_page, int update_rule, std::string table_file, int advice);
+        EmbeddingFileHeader table_header(size_t name_bytes);
+        void gather_float_rows(const long* indexes, long count, float* matrix);
+        void sum_rows(const long* indexes, int count, real scale, real* out);
+        // fused = NULL writes the embeddings themselves, otherwise count rows of it
+        void write_text_rows(FILE* file, std::vector<char*>& index2node, const long* indexes, long count, const real* fused, char separator);
+        void fuse_neighbors(CSRGraph& csr, const long* indexes, long count, real self_scale, real neighbor_scale, int weighted, real* fused);
+        void save_fused_to_file(FileGraph* file_graph, std::vector<long>& indexes, FILE* embedding_file, real self_scale, real neighbor_scale, int weighted);
 };
 #endif
@@ -0,0 +1,60 @@
+#include "neighbor_mean_cache.h"
+
+template<typename T>
+NeighborMeanCache<T>::NeighborMeanCache(FileGraph* file_graph, LookupMapper<T>* mapper, unsigned int refresh_period) {
+    this->csr = file_graph->build_csr();
+    this->mapper = mapper;
+    this->dimension = mapper->dimension;
+    this->stride = align_size(sizeof(real)*this->dimension, CACHE_LINE_SIZE)/sizeof(real);
+    this->refresh_period = refresh_period ? refresh_period : 1;
+    this->num_slots = 0;
+    this->slots.assign(this->csr.num_rows, -1);
+    for (long index=0; index<this->csr.num_rows; index++)
+        if (this->csr.offsets[index+1] > this->csr.offsets[index])
+            this->slots[index] = this->num_slots++;
+    this->means = (real*)allocate_aligned(sizeof(real)*this->num_slots*this->stride, 0);
+    this->weight_sums.assign(this->num_slots, 0.0);
+    std::vector<std::atomic<unsigned int> >(this->num_slots).swap(this->reads);
+    for (long slot=0; slot<this->num_slots; slot++)
+        this->reads[slot].store(0, std::memory_order_relaxed);
+
+    #pragma omp parallel
+    {
+        std::vector<real> scratch(this->dimension);
+        #pragma omp for schedule(dynamic, 256)
+        for (long index=0; index<this->csr.num_rows; index++)
+        {
+            long slot = this->slots[index];
+            if (slot < 0)
+                continue;
+            for (long k=this->csr.offsets[index]; k<this->csr.offsets[index+1]; k++)
+                this->weight_sums[slot] += this->csr.weights[k];
+            this->refresh(index, slot, scratch.data());
+        }
+    }
+}
+
+template<typename T>
+NeighborMeanCache<T>::~NeighborMeanCache() {
+    release_aligned(this->means, sizeof(real)*this->num_slots*this->stride, 0);
+}
+
+template<typename T>
+void NeighborMeanCache<T>::refresh(long index, long slot, real* scratch) {
+    for (int d=0; d<this->dimension; d++)
+        scratch[d] = 0.0;
+    for (long k=this->csr.offsets[index]; k<this->csr.offsets[index+1]; k++)
+    {
+        T* row = this->mapper->row(this->csr.columns[k]);
+        real scale = this->csr.weights[k]/this->weight_sums[slot];
+        for (int d=0; d<this->dimension; d++)
+            scratch[d] += scale*StorageTraits<T>::load(row[d]);
+    }
+    real* mean = this->means + slot*this->stride;
+    for (int d=0; d<this->dimension; d++)
+        mean[d] = scratch[d];
+}
+
+template class NeighborMeanCache<double>;
+template class NeighborMeanCache<float>;
+template class NeighborMeanCache<bfloat16>;
@@ -0,0 +1,91 @@
+#ifndef NEIGHBOR_MEAN_CACHE_H
+#define NEIGHBOR_MEAN_CACHE_H
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "lookup_mapper.h"
+
+#define NEIGHBOR_MEAN_REFRESH 1000
+
+template<typename T>
+class NeighborMeanCache {
+    /* NeighborMeanCache keeps, for every vertex of a graph, the weighted mean
+     * of its neighbors' embedding rows, so that aggregating the whole
+     * neighborhood costs one cached row instead of one row per neighbor.
+     * A mean is kept current when the vertex's own neighbors are updated
+     * through update_neighbor(); moves of a shared neighbor made on behalf of
+     * other vertices are picked up by a full recompute after the mean has
+     * been read `refresh_period` times, by the one reader that takes the
+     * count back to 0; it builds the mean in its own buffer and stores it in
+     * one pass, so the other readers never see a half-built mean.
+     * Only the vertices with neighbors (the items of an item-word graph) get
+     * a slot in `means`; `slots` maps a vertex to it, -1 for the others.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        CSRGraph csr;
+        LookupMapper<T>* mapper;
+        int dimension;
+        long stride;
+        unsigned int refresh_period;
+        long num_slots;
+        std::vector<long> slots;
+        real* means;
+        std::vector<double> weight_sums;
+        std::vector<std::atomic<unsigned int> > reads;
+
+        // constructor
+        NeighborMeanCache(FileGraph* file_graph, LookupMapper<T>* mapper, unsigned int refresh_period);
+        ~NeighborMeanCache();
+        NeighborMeanCache(const NeighborMeanCache&) = delete;
+        NeighborMeanCache& operator=(const NeighborMeanCache&) = delete;
+
+        long slot(long index) { return index < this->csr.num_rows ? this->slots[index] : -1; }
+        // recompute the mean of a slot through `scratch`, `dimension` reals
+        void refresh(long index, long slot, real* scratch);
+
+        // (E[index] + mean of E[neighbors])/2, or E[index] without neighbors
+        template<int DIM>
+        void embedding(long index, real* out) {
+            T* row = this->mapper->row(index);
+            long slot = this->slot(index);
+            if (slot < 0)
+            {
+                dim_sum2<DIM>(row, row, (real)0.5, out, this->dimension);
+                return;
+            }
+            if (this->reads[slot].fetch_add(1, std::memory_order_relaxed) + 1 >= this->refresh_period
+                && this->reads[slot].exchange(0, std::memory_order_relaxed) >= this->refresh_period)
+                this->refresh(index, slot, out);
+            const real* mean = this->means + slot*this->stride;
+            for (int d=0; d<(DIM ? DIM : this->dimension); d++)
+                out[d] = 0.5*(StorageTraits<T>::load(row[d]) + mean[d]);
+        }
+
+        // update the row of `neighbor`, one of index's neighbors, and move
+        // index's mean by the same step scaled by the neighbor's weight;
+        // `before` is the caller's scratch of `dimension` reals
+        template<int DIM>
+        void update_neighbor(long index, long neighbor, const real* loss_vector, real alpha, real lambda, real* before) {
+            const int n = DIM ? DIM : this->dimension;
+            T* row = this->mapper->row(neighbor);
+            for (int d=0; d<n; d++)
+                before[d] = StorageTraits<T>::load(row[d]);
+            this->mapper->template update_with_l2<DIM>(neighbor, loss_vector, alpha, lambda);
+            long slot = this->slot(index);
+            if (slot < 0)
+                return;
+
+            long begin = this->csr.offsets[index], end = this->csr.offsets[index+1];
+            const long* found = std::lower_bound(this->csr.columns.data()+begin, this->csr.columns.data()+end, neighbor);
+            if (found == this->csr.columns.data()+end || *found != neighbor)
+                return;
+            real scale = this->csr.weights[found-this->csr.columns.data()]/this->weight_sums[slot];
+            real* mean = this->means + slot*this->stride;
+            for (int d=0; d<n; d++)
+                mean[d] += scale*(StorageTraits<T>::load(row[d]) - before[d]);
+        }
+};
+#endif
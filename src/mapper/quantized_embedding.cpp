@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <vector>
+#include "quantized_embedding.h"
+#include "../util/memory.h"
+#include "../util/vector_kernels.h"
+
+int parse_quantization(std::string name) {
+    if (name == "int8")
+        return QUANTIZE_INT8;
+    if (name == "pq")
+        return QUANTIZE_PQ;
+    return -1;
+}
+
+QuantizedHeader make_quantized_header(int kind, long rows, int dimension, int subspaces, size_t name_bytes) {
+    QuantizedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, QUANTIZED_MAGIC, sizeof(header.magic));
+    header.version = QUANTIZED_VERSION;
+    header.kind = kind;
+    header.rows = rows;
+    header.dimension = dimension;
+    header.codebook_offset = align_size(sizeof(header), EMBEDDING_FILE_PAGE);
+    if (kind == QUANTIZE_PQ)
+    {
+        header.subspaces = subspaces;
+        header.code_bytes = subspaces;
+        header.codes_offset = header.codebook_offset + align_size(sizeof(float)*PQ_CENTROIDS*dimension, EMBEDDING_FILE_PAGE);
+    }
+    else
+    {
+        // the scale stays 4-byte aligned from row to row
+        header.code_bytes = sizeof(float) + align_size(dimension, sizeof(float));
+        header.codes_offset = header.codebook_offset;
+    }
+    header.dictionary_offset = align_size(header.codes_offset + rows*header.code_bytes, EMBEDDING_FILE_PAGE);
+    header.dictionary_bytes = sizeof(uint64_t)*(rows+1) + name_bytes;
+    return header;
+}
+
+static int nearest_centroid(const float* x, const float* centroids, int sub_dimension) {
+    int best = 0;
+    float best_distance = 0;
+    for (int c=0; c<PQ_CENTROIDS; c++)
+    {
+        const float* centroid = centroids + (long)c*sub_dimension;
+        float distance = 0;
+        for (int d=0; d<sub_dimension; d++)
+            distance += (x[d]-centroid[d])*(x[d]-centroid[d]);
+        if (c == 0 || distance < best_distance)
+        {
+            best = c;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+void train_product_quantizer(const float* sample, long rows, int dimension, int subspaces, float* codebook) {
+    // Lloyd's k-means per sub-space, seeded with evenly spaced sample rows;
+    // an emptied centroid is re-seeded from the next sample row in turn
+    int sub_dimension = dimension/subspaces;
+    std::vector<int> assignment(rows);
+    std::vector<double> sums((long)PQ_CENTROIDS*sub_dimension);
+    std::vector<long> counts(PQ_CENTROIDS);
+    for (int m=0; m<subspaces; m++)
+    {
+        float* centroids = codebook + (long)m*PQ_CENTROIDS*sub_dimension;
+        const float* base = sample + (long)m*sub_dimension;
+        for (int c=0; c<PQ_CENTROIDS; c++)
+            memcpy(centroids + (long)c*sub_dimension, base + (long)(c*rows/PQ_CENTROIDS)*dimension, sizeof(float)*sub_dimension);
+
+        long reseed = 0;
+        for (int iteration=0; iteration<PQ_ITERATIONS; iteration++)
+        {
+            #pragma omp parallel for schedule(static)
+            for (long r=0; r<rows; r++)
+                assignment[r] = nearest_centroid(base + r*dimension, centroids, sub_dimension);
+
+            sums.assign(sums.size(), 0.0);
+            counts.assign(counts.size(), 0);
+            for (long r=0; r<rows; r++)
+            {
+                counts[assignment[r]]++;
+                for (int d=0; d<sub_dimension; d++)
+                    sums[(long)assignment[r]*sub_dimension+d] += base[r*dimension+d];
+            }
+            for (int c=0; c<PQ_CENTROIDS; c++)
+            {
+                float* centroid = centroids + (long)c*sub_dimension;
+                if (counts[c] == 0)
+                {
+                    memcpy(centroid, base + (reseed++ % rows)*dimension, sizeof(float)*sub_dimension);
+                    continue;
+                }
+                for (int d=0; d<sub_dimension; d++)
+                    centroid[d] = sums[(long)c*sub_dimension+d]/counts[c];
+            }
+        }
+    }
+}
+
+void quantize_rows(QuantizedHeader& header, const float* codebook, const float* matrix, long count, char* codes) {
+    int dimension = header.dimension;
+    #pragma omp parallel for schedule(static)
+    for (long r=0; r<count; r++)
+    {
+        const float* x = matrix + r*dimension;
+        char* code = codes + r*header.code_bytes;
+        if (header.kind == QUANTIZE_PQ)
+        {
+            int sub_dimension = dimension/header.subspaces;
+            for (int m=0; m<(int)header.subspaces; m++)
+                code[m] = nearest_centroid(x + m*sub_dimension, codebook + (long)m*PQ_CENTROIDS*sub_dimension, sub_dimension);
+            continue;
+        }
+        // symmetric per-row scale: x ~ scale*code, code in [-127, 127]
+        float max_value = 0;
+        for (int d=0; d<dimension; d++)
+            max_value = fabsf(x[d]) > max_value ? fabsf(x[d]) : max_value;
+        float scale = max_value/127;
+        float inverse = max_value > 0 ? 127/max_value : 0;
+        memcpy(code, &scale, sizeof(float));
+        int8_t* values = (int8_t*)(code + sizeof(float));
+        for (int d=0; d<dimension; d++)
+            values[d] = (int8_t)lrintf(x[d]*inverse);
+        for (int d=dimension; d<(int)(header.code_bytes-sizeof(float)); d++)
+            values[d] = 0;
+    }
+}
+
+// the sections of a header read from a file of `bytes` bytes fit in it and
+// agree with its kind, so that no code or centroid lookup reads out of bounds
+static int valid_layout(const QuantizedHeader& header, size_t bytes) {
+    if (header.dimension == 0 || header.codes_offset > header.dictionary_offset
+        || header.dictionary_offset > bytes || header.dictionary_bytes > bytes - header.dictionary_offset)
+        return 0;
+    if (header.kind == QUANTIZE_PQ)
+    {
+        if (header.subspaces == 0 || header.dimension % header.subspaces || header.code_bytes != header.subspaces
+            || header.codebook_offset > header.codes_offset
+            || header.dimension > (header.codes_offset - header.codebook_offset)/(sizeof(float)*PQ_CENTROIDS))
+            return 0;
+    }
+    else if (header.code_bytes != sizeof(float) + align_size(header.dimension, sizeof(float)))
+        return 0;
+    return header.rows <= (header.dictionary_offset - header.codes_offset)/header.code_bytes
+        && header.rows < header.dictionary_bytes/sizeof(uint64_t);
+}
+
+QuantizedEmbedding::QuantizedEmbedding(std::string path) {
+    std::cout << "Load Quantized Embedding:" << std::endl;
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(QuantizedHeader))
+    {
+        if (fd != -1)
+            close(fd);
+        throw std::runtime_error("fail to open file " + path);
+    }
+    this->bytes = info.st_size;
+    this->data = (char*)mmap(NULL, this->bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (this->data == MAP_FAILED)
+        throw std::runtime_error("fail to map file " + path);
+
+    memcpy(&this->header, this->data, sizeof(QuantizedHeader));
+    if (memcmp(this->header.magic, QUANTIZED_MAGIC, sizeof(this->header.magic))
+        || this->header.version != QUANTIZED_VERSION
+        || this->header.kind > QUANTIZE_PQ)
+    {
+        munmap(this->data, this->bytes);
+        throw std::runtime_error("not a quantized embedding file (version " + std::to_string(QUANTIZED_VERSION) + ") " + path);
+    }
+    if (!valid_layout(this->header, this->bytes))
+    {
+        munmap(this->data, this->bytes);
+        throw std::runtime_error("quantized embedding file " + path + " is truncated or its layout is inconsistent");
+    }
+    this->rows = this->header.rows;
+    this->dimension = this->header.dimension;
+    this->kind = this->header.kind;
+    this->subspaces = this->header.subspaces;
+    this->codebook = (const float*)(this->data + this->header.codebook_offset);
+    this->offsets = (const uint64_t*)(this->data + this->header.dictionary_offset);
+    this->names = (const char*)(this->offsets + this->rows + 1);
+    std::cout << "\t" << this->rows << " rows, dimension " << this->dimension << ", " << (this->kind == QUANTIZE_PQ ? "pq" : "int8") << " <" << path << ">" << std::endl;
+}
+
+QuantizedEmbedding::~QuantizedEmbedding() {
+    munmap(this->data, this->bytes);
+}
+
+float QuantizedEmbedding::dot(long index, const float* query) {
+    const char* code = this->codes(index);
+    float result = 0;
+    if (this->kind == QUANTIZE_PQ)
+    {
+        int sub_dimension = this->dimension/this->subspaces;
+        for (int m=0; m<this->subspaces; m++)
+        {
+            const float* centroid = this->codebook + ((long)m*PQ_CENTROIDS + (uint8_t)code[m])*sub_dimension;
+            result += vk_dot(query + m*sub_dimension, centroid, sub_dimension);
+        }
+        return result;
+    }
+    float scale;
+    memcpy(&scale, code, sizeof(float));
+    const int8_t* values = (const int8_t*)(code + sizeof(float));
+    for (int d=0; d<this->dimension; d++)
+        result += query[d]*values[d];
+    return scale*result;
+}
+
+void QuantizedEmbedding::build_lookup_table(const float* query, float* table) {
+    // table[m][c] = query_m . centroid_mc
+    int sub_dimension = this->dimension/this->subspaces;
+    for (int m=0; m<this->subspaces; m++)
+        for (int c=0; c<PQ_CENTROIDS; c++)
+            table[m*PQ_CENTROIDS+c] = vk_dot(query + m*sub_dimension, this->codebook + ((long)m*PQ_CENTROIDS + c)*sub_dimension, sub_dimension);
+}
+
+float QuantizedEmbedding::dot_with_table(long index, const float* table) {
+    const uint8_t* code = (const uint8_t*)this->codes(index);
+    float result = 0;
+    for (int m=0; m<this->subspaces; m++)
+        result += table[m*PQ_CENTROIDS+code[m]];
+    return result;
+}
+
+void QuantizedEmbedding::decode(long index, float* embedding) {
+    const char* code = this->codes(index);
+    if (this->kind == QUANTIZE_PQ)
+    {
+        int sub_dimension = this->dimension/this->subspaces;
+        for (int m=0; m<this->subspaces; m++)
+            memcpy(embedding + m*sub_dimension, this->codebook + ((long)m*PQ_CENTROIDS + (uint8_t)code[m])*sub_dimension, sizeof(float)*sub_dimension);
+        return;
+    }
+    float scale;
+    memcpy(&scale, code, sizeof(float));
+    const int8_t* values = (const int8_t*)(code + sizeof(float));
+    for (int d=0; d<this->dimension; d++)
+        embedding[d] = scale*values[d];
+}
+
+std::unordered_map<std::string, long> QuantizedEmbedding::build_index() {
+    std::unordered_map<std::string, long> index;
+    index.reserve(this->rows);
+    for (long r=0; r<this->rows; r++)
+        index[this->name(r)] = r;
+    return index;
+}
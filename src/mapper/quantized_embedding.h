@@ -0,0 +1,91 @@
+#ifndef QUANTIZED_EMBEDDING_H
+#define QUANTIZED_EMBEDDING_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "embedding_file.h"
+
+#define QUANTIZED_MAGIC "SMOREQNT"
+#define QUANTIZED_VERSION 1
+
+// quantization kinds
+#define QUANTIZE_INT8 0
+#define QUANTIZE_PQ 1
+// product quantization: centroids per sub-space (one byte code), k-means
+// iterations and rows sampled to train the codebooks
+#define PQ_CENTROIDS 256
+#define PQ_ITERATIONS 16
+#define PQ_TRAIN_ROWS 65536
+
+// "int8" / "pq" -> QUANTIZE_*, -1 if unknown
+int parse_quantization(std::string name);
+
+/* Quantized embedding file, little-endian, laid out for mmap:
+ *   [header, padded to one page]
+ *   [PQ only: codebook, float [subspaces][PQ_CENTROIDS][dimension/subspaces]]
+ *   [codes: rows x code_bytes; int8 rows are a float scale and dimension
+ *    int8 values (x ~ scale*code), PQ rows are one centroid byte per sub-space]
+ *   [dictionary, as in embedding_file.h]
+ * Sections start on page boundaries.
+ */
+struct QuantizedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;                  // QUANTIZE_*
+    uint64_t rows;
+    uint64_t dimension;
+    uint64_t subspaces;             // PQ only
+    uint64_t code_bytes;
+    uint64_t codebook_offset;
+    uint64_t codes_offset;
+    uint64_t dictionary_offset;
+    uint64_t dictionary_bytes;
+};
+
+QuantizedHeader make_quantized_header(int kind, long rows, int dimension, int subspaces, size_t name_bytes);
+
+// k-means codebooks for every sub-space from `rows` sample rows
+void train_product_quantizer(const float* sample, long rows, int dimension, int subspaces, float* codebook);
+// codes (header.code_bytes each) of `count` float rows, in parallel
+void quantize_rows(QuantizedHeader& header, const float* codebook, const float* matrix, long count, char* codes);
+
+class QuantizedEmbedding {
+    /* QuantizedEmbedding maps a quantized embedding file read-only and scores
+     * rows against a float query straight from their codes. For scans over
+     * product-quantized rows, build_lookup_table() once per query and then
+     * dot_with_table() costs one table read per sub-space.
+     */
+    public:
+        QuantizedHeader header;
+        long rows;
+        int dimension, kind, subspaces;
+
+        // constructor; throws std::runtime_error if path cannot be mapped, is
+        // not a quantized embedding file or its sections do not fit
+        QuantizedEmbedding(std::string path);
+        ~QuantizedEmbedding();
+        QuantizedEmbedding(const QuantizedEmbedding&) = delete;
+        QuantizedEmbedding& operator=(const QuantizedEmbedding&) = delete;
+
+        // approximate dot products
+        float dot(long index, const float* query);
+        void build_lookup_table(const float* query, float* table);      // table: subspaces*PQ_CENTROIDS
+        float dot_with_table(long index, const float* table);
+        void decode(long index, float* embedding);
+
+        // row access
+        const char* codes(long index) { return this->data + this->header.codes_offset + index*this->header.code_bytes; }
+        const char* name(long index) { return this->names + this->offsets[index]; }
+        std::unordered_map<std::string, long> build_index();
+
+    private:
+        char* data;
+        size_t bytes;
+        const float* codebook;
+        const uint64_t* offsets;
+        const char* names;
+};
+
+#endif
@@ -0,0 +1,539 @@
+#include <fcntl.h>
+#include <netdb.h>
+#include <omp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "shared_table.h"
+
+// when a process started, in clock ticks since boot; 0 if it is not running
+static uint64_t process_start(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    std::ifstream stat(path);
+    std::string line;
+    if (!std::getline(stat, line))
+        return 0;
+    // the name in parentheses may hold spaces; starttime is the 20th field after it
+    size_t close_paren = line.rfind(')');
+    if (close_paren == std::string::npos)
+        return 0;
+    std::istringstream fields(line.substr(close_paren + 1));
+    std::string field;
+    for (int f=0; f<19 && fields >> field; f++)
+        ;
+    uint64_t start = 0;
+    fields >> start;
+    return start;
+}
+
+SharedTable::SharedTable(std::string name, size_t bytes, int processes, int rank) {
+    this->name = name[0] == '/' ? name : "/" + name;
+    this->bytes = bytes;
+    this->processes = processes;
+    this->rank = rank;
+    this->header = NULL;
+
+    if (rank == 0)
+    {
+        shm_unlink(this->name.c_str());
+        int fd = shm_open(this->name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0600);
+        if (fd != -1 && ftruncate(fd, this->mapped_bytes()) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (fd != -1)
+        {
+            void* buffer = mmap(NULL, this->mapped_bytes(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (buffer != MAP_FAILED)
+                this->header = (SharedTableHeader*)buffer;
+        }
+        if (this->header)
+        {
+            this->header->creator = getpid();
+            this->header->creator_start = process_start(getpid());
+            this->header->bytes = bytes;
+            this->header->processes = processes;
+            this->header->ready.store(0);
+            this->header->done.store(0);
+            // the magic last: a table with it is whole
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(this->header->magic, SHARED_TABLE_MAGIC, sizeof(this->header->magic));
+        }
+    }
+    else
+    {
+        // rank 0 may not have created it yet, or not yet replaced the one
+        // of a crashed run
+        for (int wait=0; wait<10*SHARED_TABLE_WAIT && !this->header; wait++)
+        {
+            struct stat status;
+            int fd = shm_open(this->name.c_str(), O_RDWR, 0600);
+            if (fd != -1 && fstat(fd, &status) == 0 && (size_t)status.st_size == this->mapped_bytes())
+            {
+                void* buffer = mmap(NULL, this->mapped_bytes(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+                if (buffer != MAP_FAILED)
+                    this->header = (SharedTableHeader*)buffer;
+                if (this->header && !this->live())
+                {
+                    munmap(buffer, this->mapped_bytes());
+                    this->header = NULL;
+                }
+            }
+            if (fd != -1)
+                close(fd);
+            if (!this->header)
+                usleep(100000);
+        }
+    }
+    if (!this->header)
+        throw std::runtime_error("fail to open shared table " + this->name);
+    this->rows = (char*)this->header + EMBEDDING_FILE_PAGE;
+}
+
+SharedTable::~SharedTable() {
+    munmap(this->header, this->mapped_bytes());
+}
+
+int SharedTable::live() {
+    if (memcmp(this->header->magic, SHARED_TABLE_MAGIC, sizeof(this->header->magic)))
+        return 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return this->header->processes == this->processes
+        && this->header->creator_start
+        && process_start(this->header->creator) == this->header->creator_start;
+}
+
+void SharedTable::ready() {
+    this->header->ready.store(1, std::memory_order_release);
+}
+
+void SharedTable::wait_ready() {
+    for (int wait=0; wait<10*SHARED_TABLE_WAIT; wait++)
+    {
+        if (!this->live())
+            break;
+        if (this->header->ready.load(std::memory_order_acquire))
+            return;
+        usleep(100000);
+    }
+    throw std::runtime_error("shared table " + this->name + " was not made ready by rank 0");
+}
+
+int SharedTable::finish() {
+    this->header->done.fetch_add(1);
+    if (this->rank != 0)
+        return 0;
+    // a process that died never reports, so rank 0 saves what it left
+    for (int wait=0; wait<100*SHARED_TABLE_FINISH_WAIT && this->header->done.load() < this->processes; wait++)
+        usleep(10000);
+    shm_unlink(this->name.c_str());
+    return this->processes - this->header->done.load();
+}
+
+static int read_all(int fd, void* buffer, size_t bytes) {
+    char* data = (char*)buffer;
+    while (bytes)
+    {
+        ssize_t got = read(fd, data, bytes);
+        if (got <= 0)
+            return -1;
+        data += got;
+        bytes -= got;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void* buffer, size_t bytes) {
+    const char* data = (const char*)buffer;
+    while (bytes)
+    {
+        // a lost peer is an error to report, not a SIGPIPE
+        ssize_t put = send(fd, data, bytes, MSG_NOSIGNAL);
+        if (put <= 0)
+            return -1;
+        data += put;
+        bytes -= put;
+    }
+    return 0;
+}
+
+// socket for the address, bound (listen) or connected; -1 on failure
+static int open_socket(std::string address, int listen) {
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un unix_address;
+        memset(&unix_address, 0, sizeof(unix_address));
+        unix_address.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.size() >= sizeof(unix_address.sun_path))
+            return -1;
+        strcpy(unix_address.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+        if (listen)
+            unlink(path.c_str());
+        int failed = listen ? bind(fd, (struct sockaddr*)&unix_address, sizeof(unix_address))
+                            : connect(fd, (struct sockaddr*)&unix_address, sizeof(unix_address));
+        if (failed)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return -1;
+    std::string host = address.substr(0, colon), port = address.substr(colon+1);
+    struct addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listen ? AI_PASSIVE : 0;
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &found) != 0)
+        return -1;
+    int fd = -1;
+    for (struct addrinfo* candidate=found; candidate && fd == -1; candidate=candidate->ai_next)
+    {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd == -1)
+            continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        // requests are small and answered one at a time
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        int failed = listen ? bind(fd, candidate->ai_addr, candidate->ai_addrlen)
+                            : connect(fd, candidate->ai_addr, candidate->ai_addrlen);
+        if (failed)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+int connect_socket(std::string address) {
+    // the server may still be loading its graphs
+    for (int wait=0; wait<10*SHARED_TABLE_WAIT; wait++)
+    {
+        int fd = open_socket(address, 0);
+        if (fd != -1)
+            return fd;
+        usleep(100000);
+    }
+    return -1;
+}
+
+int listen_socket(std::string address) {
+    int fd = open_socket(address, 1);
+    if (fd != -1 && listen(fd, 64) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static PSLayout make_layout(long size, int dimension, long stride, int precision, int update_rule, size_t row_bytes) {
+    PSLayout layout;
+    layout.size = size;
+    layout.dimension = dimension;
+    layout.stride = stride;
+    layout.precision = precision;
+    layout.update_rule = update_rule;
+    layout.row_bytes = row_bytes;
+    return layout;
+}
+
+template<typename T>
+ParameterServer<T>::ParameterServer(LookupMapper<T>* mapper, std::string address, int processes) {
+    this->mapper = mapper;
+    this->address = address;
+    this->processes = processes;
+}
+
+template<typename T>
+unsigned long long ParameterServer<T>::serve() {
+    int listen_fd = listen_socket(this->address);
+    if (listen_fd == -1)
+        throw std::runtime_error("fail to listen on " + this->address);
+    std::cout << "Parameter Server: <" << this->address << "> waiting for " << this->processes << " processes" << std::endl;
+
+    std::atomic<int> done(0);
+    std::atomic<unsigned long long> updates(0);
+    std::vector<std::thread> connections;
+    // a client that never comes must not keep the others' rows from being saved
+    double deadline = omp_get_wtime() + PS_ACCEPT_WAIT;
+    while ((int)connections.size() < this->processes)
+    {
+        double left = deadline - omp_get_wtime();
+        struct pollfd waiting = {listen_fd, POLLIN, 0};
+        if (left <= 0 || poll(&waiting, 1, (int)(1000*left) + 1) == 0)
+            break;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd != -1)
+            connections.push_back(std::thread(&ParameterServer<T>::handle, this, fd, &done, &updates));
+    }
+    close(listen_fd);
+    if ((int)connections.size() < this->processes)
+        std::cout << "\t" << this->processes - connections.size() << " processes did not connect in " << PS_ACCEPT_WAIT << " seconds" << std::endl;
+    for (size_t c=0; c<connections.size(); c++)
+        connections[c].join();
+    if (this->address.compare(0, 5, "unix:") == 0)
+        unlink(this->address.substr(5).c_str());
+    if (done.load() < (int)connections.size())
+        std::cout << "\t" << (int)connections.size() - done.load() << " processes left without finishing" << std::endl;
+    return updates.load();
+}
+
+template<typename T>
+void ParameterServer<T>::handle(int fd, std::atomic<int>* done, std::atomic<unsigned long long>* updates) {
+    LookupMapper<T>* mapper = this->mapper;
+    const size_t row_bytes = sizeof(T)*mapper->stride;
+    const long delta_reals = mapper->dimension + mapper->state_size;
+    std::vector<uint64_t> indexes;
+    std::vector<real> deltas;
+    std::vector<char> rows;
+    PSRequest request;
+    while (read_all(fd, &request, sizeof(request)) == 0)
+    {
+        int failed = 0;
+        if (request.op == PS_HELLO)
+        {
+            PSLayout layout = make_layout(mapper->size, mapper->dimension, mapper->stride, StorageTraits<T>::precision(), mapper->update_rule, row_bytes);
+            failed = write_all(fd, &layout, sizeof(layout));
+        }
+        else if (request.op == PS_PULL)
+        {
+            if (request.first + request.count > (uint64_t)mapper->size)
+                break;
+            failed = write_all(fd, mapper->row(request.first), row_bytes*request.count);
+        }
+        else if (request.op == PS_PUSH)
+        {
+            indexes.resize(request.count);
+            deltas.resize(request.count*delta_reals);
+            rows.resize(request.count*row_bytes);
+            if (read_all(fd, indexes.data(), sizeof(uint64_t)*request.count) != 0
+                || read_all(fd, deltas.data(), sizeof(real)*deltas.size()) != 0)
+                break;
+            for (uint32_t r=0; r<request.count; r++)
+            {
+                if (indexes[r] >= (uint64_t)mapper->size)
+                {
+                    failed = 1;
+                    break;
+                }
+                T* row = mapper->row(indexes[r]);
+                const real* delta = deltas.data() + r*delta_reals;
+                for (int d=0; d<mapper->dimension; d++)
+                    row[d] = StorageTraits<T>::store_stochastic(StorageTraits<T>::load(row[d]) + delta[d]);
+                real* state = mapper->state(indexes[r]);
+                for (long d=0; d<mapper->state_size; d++)
+                    state[d] += delta[mapper->dimension + d];
+                memcpy(rows.data() + r*row_bytes, row, row_bytes);
+            }
+            if (!failed)
+                failed = write_all(fd, rows.data(), rows.size());
+        }
+        else if (request.op == PS_DONE)
+        {
+            updates->fetch_add(request.first);
+            done->fetch_add(1);
+            break;
+        }
+        else
+            failed = 1;
+        if (failed)
+            break;
+    }
+    close(fd);
+}
+
+template<typename T>
+ParameterClient<T>::ParameterClient(LookupMapper<T>* mapper, std::string address) {
+    this->mapper = mapper;
+    this->refresh_slice = 0;
+    this->dirty_rows = NULL;
+    this->fd = connect_socket(address);
+    if (this->fd == -1)
+        throw std::runtime_error("fail to connect to " + address);
+
+    PSRequest request = {PS_HELLO, 0, 0};
+    PSLayout layout, expected = make_layout(mapper->size, mapper->dimension, mapper->stride, StorageTraits<T>::precision(), mapper->update_rule, this->row_bytes());
+    std::string failure;
+    if (write_all(this->fd, &request, sizeof(request)) != 0 || read_all(this->fd, &layout, sizeof(layout)) != 0)
+        failure = "lost the parameter server at " + address;
+    else if (memcmp(&layout, &expected, sizeof(layout)))
+        failure = "the parameter server's table (" + std::to_string(layout.size) + " rows, dimension " + std::to_string(layout.dimension)
+                + ") does not match this one (" + std::to_string(expected.size) + " rows, dimension " + std::to_string(expected.dimension)
+                + "), or its precision or update rule differ";
+    if (!failure.empty())
+    {
+        close(this->fd);
+        throw std::runtime_error(failure);
+    }
+
+    this->dirty_rows = new DirtyRows(mapper->size, this->row_bytes());
+    std::vector<char> rows;
+    try {
+        for (long first=0; first<mapper->size; first+=PS_BATCH_ROWS)
+            this->pull(first, first + PS_BATCH_ROWS < mapper->size ? PS_BATCH_ROWS : mapper->size - first, rows);
+    } catch (...) {
+        close(this->fd);
+        delete this->dirty_rows;
+        throw;
+    }
+    mapper->dirty_rows = this->dirty_rows;
+    std::cout << "Parameter Client: <" << address << "> pulled " << mapper->size << " rows" << std::endl;
+}
+
+template<typename T>
+ParameterClient<T>::~ParameterClient() {
+    if (this->fd != -1)
+        close(this->fd);
+    if (this->mapper->dirty_rows == this->dirty_rows)
+        this->mapper->dirty_rows = NULL;
+    delete this->dirty_rows;
+}
+
+template<typename T>
+void ParameterClient<T>::pull(long first, long count, std::vector<char>& rows) {
+    PSRequest request = {PS_PULL, (uint32_t)count, (uint64_t)first};
+    rows.resize(count*this->row_bytes());
+    if (write_all(this->fd, &request, sizeof(request)) != 0
+        || read_all(this->fd, rows.data(), rows.size()) != 0)
+        throw std::runtime_error("lost the parameter server");
+    std::vector<char> sent(this->row_bytes());
+    for (long r=0; r<count; r++)
+    {
+        // a dirty row gets the server's copy when it is pushed
+        if (!this->dirty_rows->claim(first + r))
+            continue;
+        memcpy(sent.data(), this->mapper->row(first + r), this->row_bytes());
+        this->merge(first + r, (const T*)(rows.data() + r*this->row_bytes()), (const T*)sent.data());
+    }
+}
+
+template<typename T>
+void ParameterClient<T>::merge(long index, const T* server, const T* sent) {
+    LookupMapper<T>* mapper = this->mapper;
+    T* row = mapper->row(index);
+    int written = 0;
+    for (int d=0; d<mapper->dimension; d++)
+    {
+        T value = row[d];
+        if (!memcmp(&value, sent + d, sizeof(T)))
+            row[d] = server[d];
+        else
+        {
+            row[d] = StorageTraits<T>::store_stochastic(StorageTraits<T>::load(value)
+                   + StorageTraits<T>::load(server[d]) - StorageTraits<T>::load(sent[d]));
+            written = 1;
+        }
+    }
+    real* state = (real*)(row + mapper->state_offset);
+    const real* server_state = (const real*)(server + mapper->state_offset);
+    const real* sent_state = (const real*)(sent + mapper->state_offset);
+    for (long d=0; d<mapper->state_size; d++)
+    {
+        real value = state[d];
+        if (value == sent_state[d])
+            state[d] = server_state[d];
+        else
+        {
+            state[d] = value + server_state[d] - sent_state[d];
+            written = 1;
+        }
+    }
+    // the writes made meanwhile skipped touch(), the row being marked
+    if (written)
+        this->dirty_rows->rebase(index, server);
+    else
+        this->dirty_rows->clean(index);
+}
+
+template<typename T>
+void ParameterClient<T>::push(const uint64_t* indexes, const char* bases, long count) {
+    LookupMapper<T>* mapper = this->mapper;
+    const long delta_reals = this->delta_reals();
+    std::vector<real> deltas(count*delta_reals);
+    // the rows as sent, so the server's can be merged into what they are by then
+    std::vector<char> sent(count*this->row_bytes());
+    for (long r=0; r<count; r++)
+    {
+        T* row = (T*)(sent.data() + r*this->row_bytes());
+        memcpy(row, mapper->row(indexes[r]), this->row_bytes());
+        const T* base = (const T*)(bases + r*this->row_bytes());
+        real* delta = deltas.data() + r*delta_reals;
+        for (int d=0; d<mapper->dimension; d++)
+            delta[d] = StorageTraits<T>::load(row[d]) - StorageTraits<T>::load(base[d]);
+        real* state = (real*)(row + mapper->state_offset);
+        const real* base_state = (const real*)(base + mapper->state_offset);
+        for (long d=0; d<mapper->state_size; d++)
+            delta[mapper->dimension + d] = state[d] - base_state[d];
+    }
+
+    PSRequest request = {PS_PUSH, (uint32_t)count, 0};
+    std::vector<char> rows(count*this->row_bytes());
+    if (write_all(this->fd, &request, sizeof(request)) != 0
+        || write_all(this->fd, indexes, sizeof(uint64_t)*count) != 0
+        || write_all(this->fd, deltas.data(), sizeof(real)*deltas.size()) != 0
+        || read_all(this->fd, rows.data(), rows.size()) != 0)
+        throw std::runtime_error("lost the parameter server");
+    for (long r=0; r<count; r++)
+        this->merge(indexes[r], (const T*)(rows.data() + r*this->row_bytes()), (const T*)(sent.data() + r*this->row_bytes()));
+}
+
+template<typename T>
+long ParameterClient<T>::sync() {
+    LookupMapper<T>* mapper = this->mapper;
+    const uint64_t* indexes;
+    const char* bases;
+    long pushed = this->dirty_rows->collect(&indexes, &bases);
+    for (long first=0; first<pushed; first+=PS_BATCH_ROWS)
+    {
+        long count = first + PS_BATCH_ROWS < pushed ? PS_BATCH_ROWS : pushed - first;
+        this->push(indexes + first, bases + first*this->row_bytes(), count);
+    }
+
+    long slice_begin = mapper->size*this->refresh_slice/PS_REFRESH_SLICES;
+    long slice_end = mapper->size*(this->refresh_slice+1)/PS_REFRESH_SLICES;
+    this->refresh_slice = (this->refresh_slice + 1) % PS_REFRESH_SLICES;
+    std::vector<char> rows;
+    for (long first=slice_begin; first<slice_end; first+=PS_BATCH_ROWS)
+        this->pull(first, first + PS_BATCH_ROWS < slice_end ? PS_BATCH_ROWS : slice_end - first, rows);
+    return pushed;
+}
+
+template<typename T>
+void ParameterClient<T>::done(unsigned long long updates) {
+    PSRequest request = {PS_DONE, 0, updates};
+    write_all(this->fd, &request, sizeof(request));
+    close(this->fd);
+    this->fd = -1;
+}
+
+template class ParameterServer<double>;
+template class ParameterServer<float>;
+template class ParameterServer<bfloat16>;
+template class ParameterClient<double>;
+template class ParameterClient<float>;
+template class ParameterClient<bfloat16>;
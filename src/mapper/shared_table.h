@@ -0,0 +1,173 @@
+#ifndef SHARED_TABLE_H
+#define SHARED_TABLE_H
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "lookup_mapper.h"
+
+#define SHARED_TABLE_MAGIC "SMORESHM"
+#define SHARED_TABLE_WAIT 60
+#define SHARED_TABLE_FINISH_WAIT 600
+#define PS_ACCEPT_WAIT 600
+#define PS_BATCH_ROWS 1024
+#define PS_REFRESH_SLICES 16
+
+struct SharedTableHeader {
+    char magic[8];
+    uint64_t bytes;
+    int32_t processes;
+    // rank 0 of the run that made the table: its pid and start time (see
+    // process_start), which no later process has, even with the pid reused
+    int32_t creator;
+    uint64_t creator_start;
+    std::atomic<int32_t> ready;     // rank 0 has put the rows in
+    std::atomic<int32_t> done;      // processes that finished training
+};
+
+class SharedTable {
+    /* SharedTable is a POSIX shared memory object holding one embedding
+     * table for `processes` tpr processes on the same host:
+     *   [SharedTableHeader, padded to one page][bytes of rows]
+     * Rank 0 creates it (replacing a stale object of the same name) and
+     * publishes the rows with ready(); the other ranks wait for them. An
+     * object left by a crashed run is told apart by its creator, which is
+     * no longer running, so the other ranks never train on its rows while
+     * rank 0 has yet to replace it. All processes then update the rows in
+     * place, Hogwild-style like threads. finish() tells the others this
+     * process is done; rank 0 also waits for everyone else, up to
+     * SHARED_TABLE_FINISH_WAIT seconds, so it can save the result, and then
+     * removes the object.
+     */
+    public:
+        std::string name;
+        int processes, rank;
+        size_t bytes;
+        SharedTableHeader* header;
+        char* rows;
+
+        // constructor; throws std::runtime_error if the object cannot be
+        // made, or rank > 0 finds no matching table in time
+        SharedTable(std::string name, size_t bytes, int processes, int rank);
+        ~SharedTable();
+        SharedTable(const SharedTable&) = delete;
+        SharedTable& operator=(const SharedTable&) = delete;
+
+        void ready();
+        // throws std::runtime_error if rank 0 does not make it ready in time
+        void wait_ready();
+        // returns the processes rank 0 gave up waiting for, 0 on other ranks
+        int finish();
+
+    private:
+        size_t mapped_bytes() { return EMBEDDING_FILE_PAGE + this->bytes; }
+        // made by a rank 0 that is still running, for this many processes
+        int live();
+};
+
+/* Parameter server protocol over a stream socket, in the host's byte order:
+ * every request is a PSRequest, answered as below.
+ *   PS_HELLO              -> PSLayout of the server's table
+ *   PS_PULL  first, count -> count rows (row_bytes each) from row `first`
+ *   PS_PUSH  count        followed by count uint64 row indexes and count
+ *                         deltas (delta_reals reals each: the embedding,
+ *                         then the optimizer state), added to the rows
+ *                         -> the count rows after the push
+ *   PS_DONE  first        (the client's updates) -> nothing
+ */
+#define PS_HELLO 1
+#define PS_PULL 2
+#define PS_PUSH 3
+#define PS_DONE 4
+
+struct PSRequest {
+    uint32_t op;
+    uint32_t count;
+    uint64_t first;
+};
+
+struct PSLayout {
+    uint64_t size, dimension, stride, precision, update_rule, row_bytes;
+};
+
+// "unix:/path" or "host:port" -> connected / listening socket, -1 on failure
+int connect_socket(std::string address);
+int listen_socket(std::string address);
+
+template<typename T>
+class ParameterServer {
+    /* ParameterServer serves the rows of a LookupMapper to tpr processes
+     * connected with ParameterClient, one thread per connection. Pushed
+     * deltas are added to the rows as they come, Hogwild-style, and serve()
+     * returns once the clients have reported PS_DONE or hung up; clients
+     * still missing PS_ACCEPT_WAIT seconds after it started are not waited
+     * for.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        LookupMapper<T>* mapper;
+        std::string address;
+        int processes;
+
+        // constructor
+        ParameterServer(LookupMapper<T>* mapper, std::string address, int processes);
+
+        // block until every client is done; returns the updates they made,
+        // throws std::runtime_error if the address cannot be listened on
+        unsigned long long serve();
+
+    private:
+        void handle(int fd, std::atomic<int>* done, std::atomic<unsigned long long>* updates);
+};
+
+template<typename T>
+class ParameterClient {
+    /* ParameterClient keeps a full local copy of a ParameterServer's table
+     * in `mapper`, which the local workers train on. The mapper tells
+     * `dirty_rows` of every row the workers write, with a copy of the row
+     * from before, and sync() pushes just those rows' changes (local - copy)
+     * in batches of PS_BATCH_ROWS rows and merges the server's rows back,
+     * which carries in the other processes' changes: a row becomes
+     * row + server - sent, so what the workers wrote while it was on the
+     * wire is kept, and pushed by the next sync. Each sync also pulls
+     * one of PS_REFRESH_SLICES slices of the rows, so no row is older than
+     * PS_REFRESH_SLICES syncs. Staleness is thus bounded by the sync period
+     * in updates, and a sync costs the rows written since the last one, not
+     * the table.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        LookupMapper<T>* mapper;
+        int fd;
+        long refresh_slice;
+        DirtyRows* dirty_rows;
+
+        // constructor; connects and pulls the whole table, throws
+        // std::runtime_error on failure or when the server's table is laid
+        // out differently
+        ParameterClient(LookupMapper<T>* mapper, std::string address);
+        ~ParameterClient();
+        ParameterClient(const ParameterClient&) = delete;
+        ParameterClient& operator=(const ParameterClient&) = delete;
+
+        // returns the rows pushed; throws std::runtime_error when the
+        // server is lost
+        long sync();
+        void done(unsigned long long updates);
+
+    private:
+        long delta_reals() { return this->mapper->dimension + this->mapper->state_size; }
+        size_t row_bytes() { return sizeof(T)*this->mapper->stride; }
+        // rows that are dirty are left to their push
+        void pull(long first, long count, std::vector<char>& rows);
+        void push(const uint64_t* indexes, const char* bases, long count);
+        // row += server - sent, for a row marked dirty or claimed; leaves it
+        // dirty, measured from `server`, if it was written since `sent`
+        void merge(long index, const T* server, const T* sent);
+};
+
+#endif
@@ -0,0 +1,3 @@
+#include "loss_kernels.h"
+
+const SigmoidTable sigmoid_table;
@@ -0,0 +1,154 @@
+#ifndef LOSS_KERNELS_H
+#define LOSS_KERNELS_H
+#include <cmath>
+#include "../util/vector_kernels.h"
+
+#define SIGMOID_TABLE_SIZE 2048
+#define MAX_SIGMOID 16.0
+
+class SigmoidTable {
+    /* SigmoidTable samples the sigmoid at SIGMOID_TABLE_SIZE+1 evenly spaced
+     * points of [-MAX_SIGMOID, MAX_SIGMOID] and interpolates linearly between
+     * them; outside that range it holds the end values, which are within
+     * 1.2e-7 of 0 and 1, so the error is below 3e-6 everywhere. The lookup
+     * has no branches: the input is clamped, not tested.
+     */
+    public:
+        // one guard sample past the end, so that index+1 is valid at +MAX_SIGMOID
+        double values[SIGMOID_TABLE_SIZE+2];
+
+        SigmoidTable() {
+            for (int i=0; i<=SIGMOID_TABLE_SIZE; i++)
+            {
+                double x = i * 2.0 * MAX_SIGMOID / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
+                this->values[i] = 1.0 / (1.0 + exp(-x));
+            }
+            this->values[SIGMOID_TABLE_SIZE+1] = this->values[SIGMOID_TABLE_SIZE];
+        }
+
+        double operator()(double value) const {
+            double clamped = value < -MAX_SIGMOID ? -MAX_SIGMOID : (value > MAX_SIGMOID ? MAX_SIGMOID : value);
+            double position = (clamped + MAX_SIGMOID) * (SIGMOID_TABLE_SIZE / (2.0 * MAX_SIGMOID));
+            int index = (int)position;
+            double fraction = position - index;
+            return this->values[index] + fraction * (this->values[index+1] - this->values[index]);
+        }
+};
+
+// built once at load time (loss_kernels.cpp); a namespace-scope table keeps
+// the init guard of a function-local static off the hot path
+extern const SigmoidTable sigmoid_table;
+
+inline double fast_sigmoid(double value) {
+    return sigmoid_table(value);
+}
+
+/* Allocation-free losses shared by the optimizers. Gradients are added to
+ * the *_loss buffers; DIM > 0 fixes the dimension at compile time, DIM == 0
+ * takes it from `dimension`. Functions returning int report whether the
+ * sample produced a gradient.
+ */
+
+// pair: label - from.to
+template<int DIM, typename Real>
+inline void dotproduct_loss(const Real* from_embedding, const Real* to_embedding, double label, int dimension, Real* from_loss, Real* to_loss) {
+    Real gradient = label - dim_dot<DIM>(from_embedding, to_embedding, dimension);
+    dim_axpy<DIM>(gradient, to_embedding, from_loss, dimension);
+    dim_axpy<DIM>(gradient, from_embedding, to_loss, dimension);
+}
+
+// pair: label - sigmoid(from.to)
+template<int DIM, typename Real>
+inline void loglikelihood_loss(const Real* from_embedding, const Real* to_embedding, double label, int dimension, Real* from_loss, Real* to_loss) {
+    Real gradient = label - fast_sigmoid(dim_dot<DIM>(from_embedding, to_embedding, dimension));
+    dim_axpy<DIM>(gradient, to_embedding, from_loss, dimension);
+    dim_axpy<DIM>(gradient, from_embedding, to_loss, dimension);
+}
+
+// triplet: sigmoid(-(from.pos - from.neg - margin)), both targets updated
+template<int DIM, typename Real>
+inline int margin_bpr_loss(const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, double margin, int dimension, Real* from_loss, Real* to_loss_pos, Real* to_loss_neg) {
+    Real prediction = dim_dot<DIM>(from_embedding, to_embedding_pos, dimension)
+                    - dim_dot<DIM>(from_embedding, to_embedding_neg, dimension) - margin;
+    Real gradient = fast_sigmoid(-prediction);
+    dim_axpy<DIM>(gradient, to_embedding_pos, from_loss, dimension);
+    dim_axpy<DIM>(-gradient, to_embedding_neg, from_loss, dimension);
+    dim_axpy<DIM>(gradient, from_embedding, to_loss_pos, dimension);
+    dim_axpy<DIM>(-gradient, from_embedding, to_loss_neg, dimension);
+    return 1;
+}
+
+// triplet: from.(pos - neg)
+template<int DIM, typename Real>
+inline Real bpr_prediction(const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, int dimension) {
+    return dim_dot<DIM>(from_embedding, to_embedding_pos, dimension)
+         - dim_dot<DIM>(from_embedding, to_embedding_neg, dimension);
+}
+
+// triplet: from += gradient*(pos - neg), to_loss += gradient*from (positive only)
+template<int DIM, typename Real>
+inline void bpr_gradient(Real gradient, const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, int dimension, Real* from_loss, Real* to_loss) {
+    dim_axpy<DIM>(gradient, to_embedding_pos, from_loss, dimension);
+    dim_axpy<DIM>(-gradient, to_embedding_neg, from_loss, dimension);
+    dim_axpy<DIM>(gradient, from_embedding, to_loss, dimension);
+}
+
+// triplet: sigmoid(-from.(pos - neg))
+template<int DIM, typename Real>
+inline void bpr_loss(const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, int dimension, Real* from_loss, Real* to_loss) {
+    Real prediction = bpr_prediction<DIM>(from_embedding, to_embedding_pos, to_embedding_neg, dimension);
+    bpr_gradient<DIM>((Real)fast_sigmoid(-prediction), from_embedding, to_embedding_pos, to_embedding_neg, dimension, from_loss, to_loss);
+}
+
+// triplet: bpr_loss, skipped once from.(pos - neg) > margin (HOP-Rec)
+template<int DIM, typename Real>
+inline int hoprec_loss(const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, double margin, int dimension, Real* from_loss, Real* to_loss) {
+    Real prediction = bpr_prediction<DIM>(from_embedding, to_embedding_pos, to_embedding_neg, dimension);
+    if (prediction > margin)
+        return 0;
+    bpr_gradient<DIM>((Real)fast_sigmoid(-prediction), from_embedding, to_embedding_pos, to_embedding_neg, dimension, from_loss, to_loss);
+    return 1;
+}
+
+// triplet: label - sigmoid((from + relation).to)
+template<int DIM, typename Real>
+inline void trans_loss(const Real* from_embedding, const Real* relation_embedding, const Real* to_embedding, double label, int dimension, Real* from_loss, Real* relation_loss, Real* to_loss) {
+    const int n = DIM ? DIM : dimension;
+    Real prediction = dim_dot<DIM>(from_embedding, to_embedding, dimension)
+                    + dim_dot<DIM>(relation_embedding, to_embedding, dimension);
+    Real gradient = label - fast_sigmoid(prediction);
+    for (int d=0; d<n; d++)
+    {
+        from_loss[d] += gradient * to_embedding[d];
+        relation_loss[d] += gradient * to_embedding[d];
+        to_loss[d] += gradient * (from_embedding[d] + relation_embedding[d]);
+    }
+}
+
+// quadruple: (from + relation).(pos - neg)
+template<int DIM, typename Real>
+inline Real trans_bpr_prediction(const Real* from_embedding, const Real* relation_embedding, const Real* to_pos_embedding, const Real* to_neg_embedding, int dimension) {
+    const int n = DIM ? DIM : dimension;
+    Real prediction = 0;
+    for (int d=0; d<n; d++)
+        prediction += (from_embedding[d] + relation_embedding[d]) * (to_pos_embedding[d] - to_neg_embedding[d]);
+    return prediction;
+}
+
+// quadruple: sigmoid(-prediction), prediction from trans_bpr_prediction
+template<int DIM, typename Real>
+inline void trans_bpr_gradient(Real prediction, const Real* from_embedding, const Real* relation_embedding, const Real* to_pos_embedding, const Real* to_neg_embedding, int dimension, Real* from_loss, Real* relation_loss, Real* to_pos_loss, Real* to_neg_loss) {
+    const int n = DIM ? DIM : dimension;
+    Real gradient = fast_sigmoid(-prediction);
+    for (int d=0; d<n; d++)
+    {
+        Real source = from_embedding[d] + relation_embedding[d];
+        Real target = to_pos_embedding[d] - to_neg_embedding[d];
+        from_loss[d] += gradient * target;
+        relation_loss[d] += gradient * target;
+        to_pos_loss[d] += gradient * source;
+        to_neg_loss[d] -= gradient * source;
+    }
+}
+
+#endif
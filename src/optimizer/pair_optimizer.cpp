@@ -1,54 +1,16 @@
 #include "pair_optimizer.h"
 
-PairOptimizer::PairOptimizer() {
-    // pre-compute sigmoid func
-    this->cached_sigmoid.resize(SIGMOID_TABLE_SIZE);
-    for (int i = 0; i != SIGMOID_TABLE_SIZE + 1; i++)
-    {
-        double x = i * 2.0 * MAX_SIGMOID / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
-        this->cached_sigmoid[i] = 1.0 / (1.0 + exp(-x));
-    }
+template<typename Real>
+void PairOptimizer::feed_dotproduct_loss(std::vector<Real>& from_embedding, std::vector<Real>& to_embedding, double label, int dimension, std::vector<Real>& from_loss, std::vector<Real>& to_loss) {
+    dotproduct_loss<0>(from_embedding.data(), to_embedding.data(), label, dimension, from_loss.data(), to_loss.data());
 }
 
-double PairOptimizer::fast_sigmoid(double value) {
-    if (value < -MAX_SIGMOID)
-    {
-        return 0.0;
-    }
-    else if (value > MAX_SIGMOID)
-    {
-        return 1.0;
-    }
-    else
-    {
-        return this->cached_sigmoid[ int((value + MAX_SIGMOID) * SIGMOID_TABLE_SIZE / MAX_SIGMOID / 2) ];
-    }
+template<typename Real>
+void PairOptimizer::feed_loglikelihood_loss(std::vector<Real>& from_embedding, std::vector<Real>& to_embedding, double label, int dimension, std::vector<Real>& from_loss, std::vector<Real>& to_loss) {
+    loglikelihood_loss<0>(from_embedding.data(), to_embedding.data(), label, dimension, from_loss.data(), to_loss.data());
 }
 
-void PairOptimizer::feed_dotproduct_loss(std::vector<double>& from_embedding, std::vector<double>& to_embedding, double label, int dimension, std::vector<double>& from_loss, std::vector<double>& to_loss) {
-    double gradient, prediction=0;
-    for (int d=0; d<dimension;d++)
-    {
-        prediction += from_embedding[d] * to_embedding[d];
-    }
-    gradient = label - prediction;
-    for (int d=0; d<dimension; ++d)
-    {
-        from_loss[d] += gradient * to_embedding[d];
-        to_loss[d] += gradient * from_embedding[d];
-    }
-}
-
-void PairOptimizer::feed_loglikelihood_loss(std::vector<double>& from_embedding, std::vector<double>& to_embedding, double label, int dimension, std::vector<double>& from_loss, std::vector<double>& to_loss) {
-    double gradient, prediction=0;
-    for (int d=0; d<dimension;d++)
-    {
-        prediction += from_embedding[d] * to_embedding[d];
-    }
-    gradient = label - this->fast_sigmoid(prediction);
-    for (int d=0; d<dimension; ++d)
-    {
-        from_loss[d] += gradient * to_embedding[d];
-        to_loss[d] += gradient * from_embedding[d];
-    }
-}
+template void PairOptimizer::feed_dotproduct_loss(std::vector<double>&, std::vector<double>&, double, int, std::vector<double>&, std::vector<double>&);
+template void PairOptimizer::feed_loglikelihood_loss(std::vector<double>&, std::vector<double>&, double, int, std::vector<double>&, std::vector<double>&);
+template void PairOptimizer::feed_dotproduct_loss(std::vector<float>&, std::vector<float>&, double, int, std::vector<float>&, std::vector<float>&);
+template void PairOptimizer::feed_loglikelihood_loss(std::vector<float>&, std::vector<float>&, double, int, std::vector<float>&, std::vector<float>&);
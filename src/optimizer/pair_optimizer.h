@@ -4,38 +4,29 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
-
-#define SIGMOID_TABLE_SIZE 1000
-#define MAX_SIGMOID 8.0
+#include "loss_kernels.h"
 
 class PairOptimizer {
-    private:
-        void init_sigmoid();
-
     public:
-        // constructor
-        PairOptimizer();
-
-        // variables
-        std::vector<double> cached_sigmoid;
-
         // functions
-        double fast_sigmoid(double value);
+        double fast_sigmoid(double value) { return ::fast_sigmoid(value); }
 
         // loss
         void feed_l2_loss(std::vector<double>& embedding, int dimension, std::vector<double>& loss);
-        void feed_dotproduct_loss(std::vector<double>& from_embedding,
-                                  std::vector<double>& to_embedding,
+        template<typename Real>
+        void feed_dotproduct_loss(std::vector<Real>& from_embedding,
+                                  std::vector<Real>& to_embedding,
                                   double label,
                                   int dimension,
-                                  std::vector<double>& from_loss,
-                                  std::vector<double>& to_loss);
-        void feed_loglikelihood_loss(std::vector<double>& from_embedding,
-                                     std::vector<double>& to_embedding,
+                                  std::vector<Real>& from_loss,
+                                  std::vector<Real>& to_loss);
+        template<typename Real>
+        void feed_loglikelihood_loss(std::vector<Real>& from_embedding,
+                                     std::vector<Real>& to_embedding,
                                      double label,
                                      int dimension,
-                                     std::vector<double>& from_loss,
-                                     std::vector<double>& to_loss);
+                                     std::vector<Real>& from_loss,
+                                     std::vector<Real>& to_loss);
 
 };
 #endif
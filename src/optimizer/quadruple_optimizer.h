@@ -4,45 +4,36 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
-
-#define SIGMOID_TABLE_SIZE 1000
-#define MAX_SIGMOID 8.0
+#include "loss_kernels.h"
 
 class QuadrupleOptimizer {
-    private:
-        void init_sigmoid();
-
     public:
-        // constructor
-        QuadrupleOptimizer();
-
-        // variables
-        std::vector<double> cached_sigmoid;
-
         // functions
-        double fast_sigmoid(double value);
+        double fast_sigmoid(double value) { return ::fast_sigmoid(value); }
 
         // loss
-        void feed_trans_bpr_loss(std::vector<double>& from_embedding,
-                                 std::vector<double>& relation_embedding,
-                                 std::vector<double>& to_pos_embedding,
-                                 std::vector<double>& to_neg_embedding,
+        template<typename Real>
+        void feed_trans_bpr_loss(std::vector<Real>& from_embedding,
+                                 std::vector<Real>& relation_embedding,
+                                 std::vector<Real>& to_pos_embedding,
+                                 std::vector<Real>& to_neg_embedding,
                                  int dimension,
-                                 std::vector<double>& from_loss,
-                                 std::vector<double>& relation_loss,
-                                 std::vector<double>& to_pos_loss,
-                                 std::vector<double>& to_neg_loss);
-
-        int feed_trans_margin_bpr_loss(std::vector<double>& from_embedding,
-                                       std::vector<double>& relation_embedding,
-                                       std::vector<double>& to_pos_embedding,
-                                       std::vector<double>& to_neg_embedding,
+                                 std::vector<Real>& from_loss,
+                                 std::vector<Real>& relation_loss,
+                                 std::vector<Real>& to_pos_loss,
+                                 std::vector<Real>& to_neg_loss);
+
+        template<typename Real>
+        int feed_trans_margin_bpr_loss(std::vector<Real>& from_embedding,
+                                       std::vector<Real>& relation_embedding,
+                                       std::vector<Real>& to_pos_embedding,
+                                       std::vector<Real>& to_neg_embedding,
                                        double margin,
                                        int dimension,
-                                       std::vector<double>& from_loss,
-                                       std::vector<double>& relation_loss,
-                                       std::vector<double>& to_pos_loss,
-                                       std::vector<double>& to_neg_loss);
+                                       std::vector<Real>& from_loss,
+                                       std::vector<Real>& relation_loss,
+                                       std::vector<Real>& to_pos_loss,
+                                       std::vector<Real>& to_neg_loss);
 
 
 };
@@ -4,64 +4,74 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
-
-#define SIGMOID_TABLE_SIZE 1000
-#define MAX_SIGMOID 8.0
+#include "loss_kernels.h"
 
 class TripletOptimizer {
-    private:
-        void init_sigmoid();
-
     public:
-        // constructor
-        TripletOptimizer();
-
-        // variables
-        std::vector<double> cached_sigmoid;
-
         // functions
-        double fast_sigmoid(double value);
+        double fast_sigmoid(double value) { return ::fast_sigmoid(value); }
         double skew_opt(double prediction, double location, double scale);
 
         // loss
-        int feed_margin_bpr_loss(std::vector<double>& from_embedding,
-                                 std::vector<double>& to_embedding_pos,
-                                 std::vector<double>& to_embedding_neg,
+        template<int DIM, typename Real>
+        int feed_margin_bpr_loss(const Real* from_embedding,
+                                 const Real* to_embedding_pos,
+                                 const Real* to_embedding_neg,
                                  double margin,
                                  int dimension,
-                                 std::vector<double>& from_loss,
-                                 std::vector<double>& to_loss_pos,
-                                 std::vector<double>& to_loss_neg);
-        void feed_bpr_loss(std::vector<double>& from_embedding,
-                           std::vector<double>& to_embedding_pos,
-                           std::vector<double>& to_embedding_neg,
+                                 Real* from_loss,
+                                 Real* to_loss_pos,
+                                 Real* to_loss_neg);
+        template<typename Real>
+        int feed_margin_bpr_loss(std::vector<Real>& from_embedding,
+                                 std::vector<Real>& to_embedding_pos,
+                                 std::vector<Real>& to_embedding_neg,
+                                 double margin,
+                                 int dimension,
+                                 std::vector<Real>& from_loss,
+                                 std::vector<Real>& to_loss_pos,
+                                 std::vector<Real>& to_loss_neg);
+        template<typename Real>
+        void feed_bpr_loss(std::vector<Real>& from_embedding,
+                           std::vector<Real>& to_embedding_pos,
+                           std::vector<Real>& to_embedding_neg,
                            int dimension,
-                           std::vector<double>& from_loss,
-                           std::vector<double>& to_loss);
-        int feed_hoprec_loss(std::vector<double>& from_embedding,
-                             std::vector<double>& to_embedding_pos,
-                             std::vector<double>& to_embedding_neg,
+                           std::vector<Real>& from_loss,
+                           std::vector<Real>& to_loss);
+        template<typename Real>
+        int feed_hoprec_loss(std::vector<Real>& from_embedding,
+                             std::vector<Real>& to_embedding_pos,
+                             std::vector<Real>& to_embedding_neg,
                              double margin,
                              int dimension,
-                             std::vector<double>& from_loss,
-                             std::vector<double>& to_loss);
-        void feed_trans_loss(std::vector<double>& from_embedding,
-                             std::vector<double>& relation_embedding,
-                             std::vector<double>& to_embedding,
+                             std::vector<Real>& from_loss,
+                             std::vector<Real>& to_loss);
+        template<typename Real>
+        void feed_trans_loss(std::vector<Real>& from_embedding,
+                             std::vector<Real>& relation_embedding,
+                             std::vector<Real>& to_embedding,
                              double label,
                              int dimension,
-                             std::vector<double>& from_loss,
-                             std::vector<double>& relation_loss,
-                             std::vector<double>& to_loss);
-        int feed_skew_opt_loss(std::vector<double>& from_embedding,
-                             std::vector<double>& to_embedding_pos,
-                             std::vector<double>& to_embedding_neg,
+                             std::vector<Real>& from_loss,
+                             std::vector<Real>& relation_loss,
+                             std::vector<Real>& to_loss);
+        template<typename Real>
+        int feed_skew_opt_loss(std::vector<Real>& from_embedding,
+                             std::vector<Real>& to_embedding_pos,
+                             std::vector<Real>& to_embedding_neg,
                              double location,
                              double scale,
                              int dimension,
-                             std::vector<double>& from_loss,
-                             std::vector<double>& to_loss);
+                             std::vector<Real>& from_loss,
+                             std::vector<Real>& to_loss);
 
 
 };
+
+template<int DIM, typename Real>
+inline int TripletOptimizer::feed_margin_bpr_loss(const Real* from_embedding, const Real* to_embedding_pos, const Real* to_embedding_neg, double margin, int dimension, Real* from_loss, Real* to_loss_pos, Real* to_loss_neg) {
+    /* Dimension-specialized, allocation-free margin BPR; DIM == 0 for any dimension.
+     */
+    return margin_bpr_loss<DIM>(from_embedding, to_embedding_pos, to_embedding_neg, margin, dimension, from_loss, to_loss_pos, to_loss_neg);
+}
 #endif
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include "bucket_sampler.h"
+
+void deal_by_degree(std::vector<long> rows, const std::vector<long>& degrees, int partitions, std::vector<int>& parts) {
+    std::stable_sort(rows.begin(), rows.end(),
+                     [&degrees](long a, long b) { return degrees[a] > degrees[b]; });
+    // 0, 1, .., P-1, P-1, .., 1, 0, 0, 1, ..: each round of P hands the
+    // heavier rows to the parts that got the lighter ones in the last
+    for (long r=0; r<(long)rows.size(); r++)
+    {
+        int position = r % partitions;
+        parts[rows[r]] = (r/partitions) % 2 ? partitions - 1 - position : position;
+    }
+}
+
+BucketSampler::BucketSampler(FileGraph* file_graph, int partitions, double global) {
+    std::cout << "Build Bucket Sampler:" << std::endl;
+    CSRGraph csr = file_graph->build_csr();
+    this->partitions = partitions;
+    this->global = global;
+    this->user_part.assign(csr.num_rows, -1);
+    this->item_part.assign(csr.num_rows, -1);
+    this->part_items.resize(partitions);
+
+    // users are the rows with edges, items the rows they point to
+    std::vector<long> users, item_degrees(csr.num_rows, 0);
+    for (long row=0; row<csr.num_rows; row++)
+    {
+        if (csr.offsets[row+1] > csr.offsets[row])
+            users.push_back(row);
+        for (long e=csr.offsets[row]; e<csr.offsets[row+1]; e++)
+            item_degrees[csr.columns[e]]++;
+    }
+    std::vector<long> items;
+    for (long row=0; row<csr.num_rows; row++)
+        if (item_degrees[row])
+            items.push_back(row);
+    // an empty part would leave buckets with no edges and no negatives to draw
+    if ((size_t)partitions > users.size() || (size_t)partitions > items.size())
+        throw std::invalid_argument(std::to_string(partitions) + " partitions for " + std::to_string(users.size())
+                                    + " users and " + std::to_string(items.size()) + " items: each part needs one of each");
+    std::vector<long> user_degrees(csr.num_rows, 0);
+    for (size_t u=0; u<users.size(); u++)
+        user_degrees[users[u]] = csr.offsets[users[u]+1] - csr.offsets[users[u]];
+    deal_by_degree(users, user_degrees, partitions, this->user_part);
+    deal_by_degree(items, item_degrees, partitions, this->item_part);
+    for (size_t i=0; i<items.size(); i++)
+        this->part_items[this->item_part[items[i]]].push_back(items[i]);
+
+    // edges appended user by user, so every user's edges in a bucket are a run
+    int buckets = partitions*partitions;
+    this->bucket_edges.resize(buckets);
+    for (size_t u=0; u<users.size(); u++)
+    {
+        long user = users[u];
+        for (long e=csr.offsets[user]; e<csr.offsets[user+1]; e++)
+        {
+            int b = this->bucket(this->user_part[user], this->item_part[csr.columns[e]]);
+            BucketEdge edge = {user, csr.columns[e], 0, 0};
+            this->bucket_edges[b].push_back(edge);
+        }
+    }
+    long smallest = -1, largest = 0;
+    for (int b=0; b<buckets; b++)
+    {
+        std::vector<BucketEdge>& edges = this->bucket_edges[b];
+        long size = edges.size();
+        for (long first=0, last; first<size; first=last)
+        {
+            for (last=first; last<size && edges[last].user == edges[first].user; last++);
+            for (long e=first; e<last; e++)
+            {
+                edges[e].first = first;
+                edges[e].last = last;
+            }
+        }
+        if (smallest == -1 || size < smallest)
+            smallest = size;
+        if (size > largest)
+            largest = size;
+    }
+    std::cout << "\t" << users.size() << " users and " << items.size() << " items in " << partitions
+              << " parts, " << buckets << " buckets of " << smallest << " to " << largest << " edges" << std::endl;
+}
+
+BucketRounds::BucketRounds(BucketSampler& sampler, int workers, int passes, unsigned long long total) : arrivals(0) {
+    int partitions = sampler.partitions;
+    this->workers = workers;
+    this->rounds = passes*partitions;
+    this->quotas.resize((long)this->rounds*workers);
+    this->worker_updates.assign(workers, 0);
+
+    long edges = 0;
+    for (int b=0; b<partitions*partitions; b++)
+        edges += sampler.edges(b);
+    // cumulative rounding, so the quotas add up to total exactly
+    double share = edges ? (double)total/passes/edges : 0.0;
+    double cumulative = 0.0;
+    unsigned long long assigned = 0;
+    for (int round=0; round<this->rounds; round++)
+    {
+        for (int p=0; p<partitions; p++)
+        {
+            BucketQuota quota;
+            quota.bucket = sampler.bucket(p, (p + round) % partitions);
+            cumulative += share*sampler.edges(quota.bucket);
+            unsigned long long target = (round == this->rounds-1 && p == partitions-1) ? total : (unsigned long long)(cumulative + 0.5);
+            quota.updates = target > assigned ? target - assigned : 0;
+            assigned += quota.updates;
+            if (!quota.updates)
+                continue;
+            int worker = p % workers;
+            this->quotas[(long)round*workers + worker].push_back(quota);
+            this->worker_updates[worker] += quota.updates;
+        }
+    }
+}
+
+int BucketRounds::next(int worker, BucketCursor& cursor, std::atomic<int>* stop) {
+    while (cursor.round < this->rounds)
+    {
+        std::vector<BucketQuota>& buckets = this->quotas[cursor.round*this->workers + worker];
+        if (cursor.slot < buckets.size() && cursor.drawn < buckets[cursor.slot].updates)
+        {
+            cursor.drawn++;
+            return buckets[cursor.slot].bucket;
+        }
+        if (cursor.slot < buckets.size())
+        {
+            cursor.slot++;
+            cursor.drawn = 0;
+            continue;
+        }
+        // the round is over for this worker; the last one has no one to wait for
+        cursor.round++;
+        cursor.slot = 0;
+        cursor.drawn = 0;
+        if (cursor.round == this->rounds)
+            break;
+        this->arrivals.fetch_add(1);
+        while (this->arrivals.load() < cursor.round*this->workers)
+        {
+            if (stop->load(std::memory_order_relaxed))
+                return -1;
+            std::this_thread::yield();
+        }
+    }
+    return -1;
+}
+
+void BucketRounds::leave(BucketCursor& cursor) {
+    // one arrival at the end of every round but the last
+    long arrived = cursor.round < this->rounds ? cursor.round : this->rounds - 1;
+    this->arrivals.fetch_add(this->rounds - 1 - arrived);
+    cursor.round = this->rounds;
+}
@@ -0,0 +1,107 @@
+#ifndef BUCKET_SAMPLER_H
+#define BUCKET_SAMPLER_H
+#include <atomic>
+#include <vector>
+#include "../util/file_graph.h"
+#include "../util/random.h"
+
+#define BUCKET_PASSES 10
+#define BUCKET_NEGATIVES 0.5
+
+struct BucketEdge {
+    // an edge, and the run [first, last) of its user's edges in the bucket
+    long user, item, first, last;
+};
+
+// rows -> parts[row] in [0, partitions): rows by decreasing degree, dealt
+// to the parts in snake order so every part gets about the same total degree
+void deal_by_degree(std::vector<long> rows, const std::vector<long>& degrees, int partitions, std::vector<int>& parts);
+
+class BucketSampler {
+    /* BucketSampler splits the users and the items of a user-item graph into
+     * `partitions` parts each, balanced by degree (see deal_by_degree) so
+     * the parts hold about as many edges, and groups the edges into P x P
+     * buckets (user part p, item part q), bucket p*P + q.
+     * Drawing inside one bucket touches the rows of one user part and one
+     * item part only, so a worker's working set is ~2/P of the users and
+     * items. Edges are drawn uniformly; the weights are not used.
+     * Negatives only ever drawn in-bucket leave the scores of items of
+     * different parts uncalibrated against each other, so a `global` share
+     * of them comes from any part.
+     */
+    public:
+        int partitions;
+        double global;
+        std::vector<int> user_part, item_part;
+        std::vector<std::vector<long> > part_items;
+        // per bucket, the edges grouped by user
+        std::vector<std::vector<BucketEdge> > bucket_edges;
+
+        // constructor; throws std::invalid_argument when there are fewer
+        // users or items than partitions
+        BucketSampler(FileGraph* file_graph, int partitions, double global);
+
+        int bucket(int user_part, int item_part) { return user_part*this->partitions + item_part; }
+        long edges(int bucket) { return this->bucket_edges[bucket].size(); }
+        // an edge of the bucket
+        const BucketEdge& draw_an_edge(int bucket) {
+            return this->bucket_edges[bucket][(long)random_range(0, this->edges(bucket))];
+        }
+        // an item of the edge's user inside the bucket
+        long draw_a_context(int bucket, const BucketEdge& edge) {
+            return this->bucket_edges[bucket][(long)random_range(edge.first, edge.last)].item;
+        }
+        // an item of the bucket's item part, or a `global` share of the time of any part
+        long draw_a_negative(int bucket) {
+            int part = this->global && random_prob() < this->global ? (int)random_range(0, this->partitions) : bucket % this->partitions;
+            const std::vector<long>& items = this->part_items[part];
+            return items[(long)random_range(0, items.size())];
+        }
+};
+
+struct BucketQuota {
+    int bucket;
+    unsigned long long updates;
+};
+
+struct BucketCursor {
+    // a worker's position in BucketRounds
+    long round;
+    size_t slot;
+    unsigned long long drawn;
+    BucketCursor() : round(0), slot(0), drawn(0) {}
+};
+
+class BucketRounds {
+    /* BucketRounds schedules the buckets of a BucketSampler: `passes` times
+     * over, round r of a pass trains the buckets (p, (p+r) % P) for every p,
+     * which share no user part and no item part. The workers training them
+     * concurrently thus write different user rows, and different item rows
+     * through their positive edges; the `global` share of negatives, drawn
+     * from any item part, and the words, which all the items share, can
+     * still write the same rows, racing Hogwild-style as without partitions.
+     * Bucket p of a round goes to worker p % workers, and a pass gives every
+     * bucket its share of `total` updates by its number of edges. A worker
+     * waits at the end of each round until all the workers got there.
+     */
+    public:
+        int workers, rounds;
+        // [round*workers + worker] -> the worker's buckets in the round
+        std::vector<std::vector<BucketQuota> > quotas;
+        std::vector<unsigned long long> worker_updates;
+
+        // constructor
+        BucketRounds(BucketSampler& sampler, int workers, int passes, unsigned long long total);
+
+        // the bucket of the worker's next sample, -1 when its rounds are over
+        // or *stop was raised while waiting for the others
+        int next(int worker, BucketCursor& cursor, std::atomic<int>* stop);
+        // a worker that is done arrives at the rounds it has not reached,
+        // so the others do not wait for it
+        void leave(BucketCursor& cursor);
+
+    private:
+        std::atomic<long> arrivals;
+};
+
+#endif
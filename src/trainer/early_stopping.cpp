@@ -0,0 +1,147 @@
+#include <omp.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "early_stopping.h"
+
+std::vector<ValidationPair> read_validation_pairs(std::string path, FileGraph* file_graph, const std::vector<long>& items) {
+    std::ifstream file(path.c_str());
+    if (!file)
+        throw std::runtime_error("fail to open validation file " + path);
+    std::vector<std::pair<long, long> > edges;
+    std::string line, user, item;
+    while (std::getline(file, line))
+    {
+        std::stringstream fields(line);
+        if (!(fields >> user >> item))
+            continue;
+        long user_index = file_graph->node2index.search_key(&user[0]);
+        long item_index = file_graph->node2index.search_key(&item[0]);
+        if (user_index >= 0 && item_index >= 0)
+            edges.push_back(std::make_pair(user_index, item_index));
+    }
+    std::cout << "Validation Edges: " << edges.size() << " known edges in <" << path << ">" << std::endl;
+
+    std::vector<ValidationPair> pairs;
+    if (edges.empty() || items.empty())
+        return pairs;
+    unsigned long long state = VALID_SEED;
+    long sample = edges.size() < VALID_SAMPLE ? edges.size() : VALID_SAMPLE;
+    for (long e=0; e<sample; e++)
+    {
+        // all of them, or VALID_SAMPLE drawn with replacement
+        const std::pair<long, long>& edge = sample == (long)edges.size() ? edges[e] : edges[(long)(seeded_uniform(&state)*edges.size()) % edges.size()];
+        for (int n=0; n<VALID_NEGATIVES; n++)
+        {
+            ValidationPair pair;
+            pair.user = edge.first;
+            pair.item_pos = edge.second;
+            pair.item_neg = items[(long)(seeded_uniform(&state)*items.size()) % items.size()];
+            pairs.push_back(pair);
+        }
+    }
+    return pairs;
+}
+
+template<typename T>
+EarlyStopping<T>::EarlyStopping(LookupMapper<T>* mapper, const std::vector<ValidationPair>& pairs, double period, int patience, std::atomic<int>* stop) {
+    this->mapper = mapper;
+    this->pairs = pairs;
+    this->period = period;
+    this->patience = patience;
+    this->stop = stop;
+    this->best_auc = -1.0;
+    this->best_time = 0.0;
+    this->evaluations = 0;
+    this->since_best = 0;
+    this->best_rows = NULL;
+    this->finished = 0;
+    this->start_time = omp_get_wtime();
+    this->thread = std::thread(&EarlyStopping<T>::run, this);
+}
+
+template<typename T>
+EarlyStopping<T>::~EarlyStopping() {
+    if (this->thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->finished = 1;
+        }
+        this->wake.notify_one();
+        this->thread.join();
+    }
+    release_aligned(this->best_rows, this->mapper->bytes(), 0);
+}
+
+template<typename T>
+double EarlyStopping<T>::evaluate() {
+    const int dimension = this->mapper->dimension;
+    long ranked = 0;
+    for (size_t p=0; p<this->pairs.size(); p++)
+    {
+        const ValidationPair& pair = this->pairs[p];
+        T* user = this->mapper->row(pair.user);
+        T* pos = this->mapper->row(pair.item_pos);
+        T* neg = this->mapper->row(pair.item_neg);
+        real margin = 0;
+        for (int d=0; d<dimension; d++)
+            margin += StorageTraits<T>::load(user[d])*(StorageTraits<T>::load(pos[d]) - StorageTraits<T>::load(neg[d]));
+        ranked += margin > 0;
+    }
+    return this->pairs.empty() ? 0.0 : (double)ranked/this->pairs.size();
+}
+
+template<typename T>
+void EarlyStopping<T>::run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->finished)
+    {
+        this->wake.wait_for(lock, std::chrono::duration<double>(this->period));
+        if (this->finished)
+            break;
+        double auc = this->evaluate();
+        double elapsed = omp_get_wtime() - this->start_time;
+        this->evaluations++;
+        if (auc > this->best_auc + VALID_MIN_DELTA)
+        {
+            if (!this->best_rows)
+                this->best_rows = (T*)allocate_aligned(this->mapper->bytes(), 0);
+            memcpy(this->best_rows, this->mapper->embedding, this->mapper->bytes());
+            this->best_auc = auc;
+            this->best_time = elapsed;
+            this->since_best = 0;
+        }
+        else
+            this->since_best++;
+        printf("\n\tValidation AUC %.4f after %.1f s (best %.4f at %.1f s)\n", auc, elapsed, this->best_auc, this->best_time);
+        if (this->patience && this->since_best >= this->patience && !this->stop->load())
+        {
+            printf("\tno improvement in %d evaluations, stopping\n", this->since_best);
+            this->stop->store(1);
+        }
+    }
+}
+
+template<typename T>
+void EarlyStopping<T>::finish() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->finished = 1;
+    }
+    this->wake.notify_one();
+    this->thread.join();
+
+    double auc = this->evaluate();
+    std::cout << "Validation AUC: " << auc << " at the end";
+    if (this->best_rows && this->best_auc > auc)
+    {
+        memcpy(this->mapper->embedding, this->best_rows, this->mapper->bytes());
+        std::cout << ", restored the snapshot of " << this->best_time << " s with " << this->best_auc;
+    }
+    std::cout << std::endl;
+}
+
+template class EarlyStopping<double>;
+template class EarlyStopping<float>;
+template class EarlyStopping<bfloat16>;
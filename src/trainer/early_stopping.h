@@ -0,0 +1,72 @@
+#ifndef EARLY_STOPPING_H
+#define EARLY_STOPPING_H
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../util/file_graph.h"
+#include "../mapper/lookup_mapper.h"
+
+#define VALID_SAMPLE 2000
+#define VALID_NEGATIVES 10
+#define VALID_PERIOD 10.0
+#define VALID_PATIENCE 5
+#define VALID_MIN_DELTA 0.0005
+#define VALID_SEED 0x7A1DULL
+
+struct ValidationPair {
+    // a held-out (user, item) edge and a uniformly drawn item it should outrank
+    long user, item_pos, item_neg;
+};
+
+// VALID_SAMPLE edges of the user-item file at path (one "user item [weight]"
+// per line) whose nodes both appear in file_graph, each with VALID_NEGATIVES
+// items drawn from `items`; the draw is seeded so every run scores the same
+// pairs. Throws std::runtime_error if the file cannot be opened
+std::vector<ValidationPair> read_validation_pairs(std::string path, FileGraph* file_graph, const std::vector<long>& items);
+
+template<typename T>
+class EarlyStopping {
+    /* EarlyStopping scores held-out edges by sampled AUC, the fraction of
+     * validation pairs where user.item_pos > user.item_neg on the raw rows,
+     * from a background thread every `period` seconds while the workers
+     * train. Every improvement by more than VALID_MIN_DELTA copies the table
+     * aside (a fuzzy snapshot, like a checkpoint), and after `patience`
+     * evaluations without one it raises `stop` for the workers; patience 0
+     * never stops. finish() scores the final table and puts the best
+     * snapshot back when that one scored higher.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        LookupMapper<T>* mapper;
+        std::vector<ValidationPair> pairs;
+        double period;
+        int patience;
+        std::atomic<int>* stop;
+        double best_auc, best_time;
+        int evaluations, since_best;
+        T* best_rows;
+
+        // constructor; the thread starts right away
+        EarlyStopping(LookupMapper<T>* mapper, const std::vector<ValidationPair>& pairs, double period, int patience, std::atomic<int>* stop);
+        ~EarlyStopping();
+        EarlyStopping(const EarlyStopping&) = delete;
+        EarlyStopping& operator=(const EarlyStopping&) = delete;
+
+        double evaluate();
+        void finish();
+
+    private:
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        int finished;
+        double start_time;
+        void run();
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include <omp.h>
+#include <thread>
+#include "tpr_step.h"
+
+void draw_tpr_sample(VCSampler& ui_sampler, VCSampler& iw_sampler, int num_pairs, int word_of_positive, TPRSample& sample) {
+    sample.user = ui_sampler.draw_a_vertex();
+    sample.item_given = ui_sampler.draw_a_context(sample.user);
+    sample.pairs.resize(num_pairs);
+    for (int p=0; p<num_pairs; p++)
+    {
+        TPRPair& pair = sample.pairs[p];
+        pair.item_pos = ui_sampler.draw_a_context(sample.user);
+        pair.word_pos = iw_sampler.draw_a_context_safely(word_of_positive ? pair.item_pos : sample.item_given);
+        pair.item_neg = ui_sampler.draw_a_context_uniformly();
+        pair.word_neg = iw_sampler.draw_a_context_safely(pair.item_neg);
+    }
+}
+
+void draw_tpr_bucket_sample(BucketSampler& bucket_sampler, int bucket, VCSampler& iw_sampler, int num_pairs, int word_of_positive, TPRSample& sample) {
+    const BucketEdge& edge = bucket_sampler.draw_an_edge(bucket);
+    sample.user = edge.user;
+    sample.item_given = bucket_sampler.draw_a_context(bucket, edge);
+    sample.pairs.resize(num_pairs);
+    for (int p=0; p<num_pairs; p++)
+    {
+        TPRPair& pair = sample.pairs[p];
+        pair.item_pos = bucket_sampler.draw_a_context(bucket, edge);
+        pair.word_pos = iw_sampler.draw_a_context_safely(word_of_positive ? pair.item_pos : sample.item_given);
+        pair.item_neg = bucket_sampler.draw_a_negative(bucket);
+        pair.word_neg = iw_sampler.draw_a_context_safely(pair.item_neg);
+    }
+}
+
+double produce_tpr_samples(VCSampler& ui_sampler, VCSampler& iw_sampler, int num_pairs, int word_of_positive,
+                           std::vector<SPSCRing<TPRSample>*>& rings, std::vector<unsigned long long>& counts, std::atomic<int>* stop) {
+    const int burst = 16;
+    std::vector<unsigned long long> remaining = counts;
+    unsigned long long total_remaining = 0;
+    for (size_t r=0; r<rings.size(); r++)
+        total_remaining += remaining[r];
+
+    double waiting = 0.0;
+    while (total_remaining)
+    {
+        int produced = 0;
+        for (size_t r=0; r<rings.size(); r++)
+        {
+            TPRSample* sample;
+            for (int b=0; b<burst && remaining[r] && (sample = rings[r]->produce_slot()); b++)
+            {
+                draw_tpr_sample(ui_sampler, iw_sampler, num_pairs, word_of_positive, *sample);
+                rings[r]->produce();
+                remaining[r]--;
+                produced++;
+            }
+        }
+        total_remaining -= produced;
+        if (!produced)
+        {
+            // the compute threads stopped early and will not drain them
+            if (stop->load(std::memory_order_relaxed))
+                break;
+            // every ring is full: the compute threads are the bottleneck
+            double start = omp_get_wtime();
+            std::this_thread::yield();
+            waiting += omp_get_wtime() - start;
+        }
+    }
+    return waiting;
+}
@@ -0,0 +1,167 @@
+#ifndef TPR_STEP_H
+#define TPR_STEP_H
+#include <atomic>
+#include <vector>
+#include "../util/spsc_ring.h"
+#include "../sampler/vc_sampler.h"
+#include "../sampler/bucket_sampler.h"
+#include "../mapper/lookup_mapper.h"
+#include "../mapper/neighbor_mean_cache.h"
+#include "../mapper/hot_row_replicas.h"
+#include "../optimizer/loss_kernels.h"
+
+#define TPR_MARGIN 8.0
+#define TPR_RING_SIZE 1024
+#define TPR_INTERLEAVE 1
+
+struct TPRPair {
+    // an item the user has and a uniformly drawn one, each with one of its
+    // words (-1 for an item without words)
+    long item_pos, word_pos, item_neg, word_neg;
+};
+
+struct TPRSample {
+    /* TPRSample is one tpr update: a user with one of its items, and the
+     * (positive, negative) item pairs it is ranked on. `pairs` keeps its
+     * capacity, so drawing into the same sample again does not allocate.
+     */
+    long user, item_given;
+    std::vector<TPRPair> pairs;
+};
+
+// user, item_given and num_pairs pairs; the positive's word is drawn from the
+// positive itself with word_of_positive, otherwise from item_given
+void draw_tpr_sample(VCSampler& ui_sampler, VCSampler& iw_sampler, int num_pairs, int word_of_positive, TPRSample& sample);
+// the same from one bucket of the partitioned mode: an edge of the bucket
+// for the user, its positives among the user's edges in the bucket and its
+// negatives from the bucket's item part; words come from the whole graph
+void draw_tpr_bucket_sample(BucketSampler& bucket_sampler, int bucket, VCSampler& iw_sampler, int num_pairs, int word_of_positive, TPRSample& sample);
+// sampler thread of the pipelined mode: draws counts[r] samples into rings[r]
+// for every ring, a few at a time round robin, or until *stop is raised while
+// the rings are full; returns the seconds it spent waiting for a full ring to drain
+double produce_tpr_samples(VCSampler& ui_sampler, VCSampler& iw_sampler, int num_pairs, int word_of_positive,
+                           std::vector<SPSCRing<TPRSample>*>& rings, std::vector<unsigned long long>& counts, std::atomic<int>* stop);
+
+template<typename T, int DIM>
+class TPRStep {
+    /* TPRStep is the fused tpr update of one TPRSample: the rows of every
+     * pair are read once into the step's buffers, the margin BPR gradients of
+     * the user, the positive and the negative come out of a single pass, and
+     * each touched row is written once. With word_means the items aggregate
+     * all of their words through the cache, otherwise (item + word)/2.
+     * With hot_rows, rows are read and updated through the worker's replicas.
+     * The loss and gradient of every pair, and the norms of the user and
+     * item_given rows after their update, go to `stats`, for one sample in
+     * TELEMETRY_PERIOD.
+     * prefetch() requests the rows a sample will touch; calling it a few
+     * samples ahead of step() overlaps their cache misses with the steps
+     * in between.
+     * The buffers belong to the step, so keep one per worker.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        LookupMapper<T>* mapper;
+        NeighborMeanCache<T>* word_means;
+        HotRowReplicas<T>* hot_rows;
+        TrainingStats* stats;
+        unsigned int samples;
+        int dimension;
+        real user_reg, item_reg;
+        DimVector<real, DIM> user_embed, pos_embed, neg_embed, user_loss, pos_loss, neg_loss, word_before;
+
+        // constructor
+        TPRStep(LookupMapper<T>* mapper, NeighborMeanCache<T>* word_means, HotRowReplicas<T>* hot_rows, TrainingStats* stats, real user_reg, real item_reg) :
+            mapper(mapper), word_means(word_means), hot_rows(hot_rows), stats(stats), samples(0), dimension(mapper->dimension), user_reg(user_reg), item_reg(item_reg),
+            user_embed(mapper->dimension), pos_embed(mapper->dimension), neg_embed(mapper->dimension),
+            user_loss(mapper->dimension), pos_loss(mapper->dimension), neg_loss(mapper->dimension), word_before(mapper->dimension) {}
+
+        void step(const TPRSample& sample, real alpha) {
+            const int n = DIM ? DIM : this->dimension;
+            real* user_embed = this->user_embed.ptr();
+            real* pos_embed = this->pos_embed.ptr();
+            real* neg_embed = this->neg_embed.ptr();
+            real* user_loss = this->user_loss.ptr();
+            real* pos_loss = this->pos_loss.ptr();
+            real* neg_loss = this->neg_loss.ptr();
+
+            dim_sum2<DIM>(this->row(sample.user), this->row(sample.item_given), (real)0.5, user_embed, n);
+            dim_zero<DIM>(user_loss, n);
+            // telemetry on every TELEMETRY_PERIOD-th sample keeps the hot loop free of it
+            int record = ++this->samples % TELEMETRY_PERIOD == 0;
+            for (size_t p=0; p<sample.pairs.size(); p++)
+            {
+                const TPRPair& pair = sample.pairs[p];
+                this->item_embedding(pair.item_pos, pair.word_pos, pos_embed);
+                this->item_embedding(pair.item_neg, pair.word_neg, neg_embed);
+
+                real prediction = dim_dot<DIM>(user_embed, pos_embed, n) - dim_dot<DIM>(user_embed, neg_embed, n) - TPR_MARGIN;
+                real gradient = fast_sigmoid(-prediction);
+                // -log sigmoid(prediction), bounded by the table's saturation
+                if (record)
+                    this->stats->add_pair(-std::log(1 - gradient), gradient);
+                for (int d=0; d<n; d++)
+                {
+                    user_loss[d] += gradient*(pos_embed[d] - neg_embed[d]);
+                    pos_loss[d] = gradient*user_embed[d];
+                    neg_loss[d] = -pos_loss[d];
+                }
+                this->update_item(pair.item_pos, pair.word_pos, pos_loss, alpha);
+                this->update_item(pair.item_neg, pair.word_neg, neg_loss, alpha);
+            }
+            this->update(sample.user, user_loss, alpha, this->user_reg);
+            this->update(sample.item_given, user_loss, alpha, this->user_reg);
+            if (record)
+            {
+                this->stats->add_row(this->mapper->norm(this->row(sample.user)));
+                this->stats->add_row(this->mapper->norm(this->row(sample.item_given)));
+            }
+        }
+
+        void prefetch(const TPRSample& sample) {
+            this->prefetch_row(sample.user);
+            this->prefetch_row(sample.item_given);
+            for (size_t p=0; p<sample.pairs.size(); p++)
+            {
+                const TPRPair& pair = sample.pairs[p];
+                this->prefetch_row(pair.item_pos);
+                this->prefetch_row(pair.item_neg);
+                if (pair.word_pos != -1)
+                    this->prefetch_row(pair.word_pos);
+                if (pair.word_neg != -1)
+                    this->prefetch_row(pair.word_neg);
+            }
+        }
+
+    private:
+        void prefetch_row(long index) {
+            // embedding and optimizer state
+            prefetch_lines(this->row(index), sizeof(T)*this->mapper->stride);
+        }
+        T* row(long index) {
+            return this->hot_rows ? this->hot_rows->row(index) : this->mapper->row(index);
+        }
+        void update(long index, const real* loss, real alpha, real lambda) {
+            if (this->hot_rows)
+                this->hot_rows->template update_with_l2<DIM>(index, loss, alpha, lambda);
+            else
+                this->mapper->template update_with_l2<DIM>(index, loss, alpha, lambda);
+        }
+        void item_embedding(long item, long word, real* out) {
+            if (this->word_means)
+                this->word_means->template embedding<DIM>(item, out);
+            else
+                dim_sum2<DIM>(this->row(item), this->row(word == -1 ? item : word), (real)0.5, out, this->dimension);
+        }
+        void update_item(long item, long word, const real* loss, real alpha) {
+            this->update(item, loss, alpha, this->item_reg);
+            if (word == -1)
+                return;
+            if (this->word_means)
+                this->word_means->template update_neighbor<DIM>(item, word, loss, alpha, this->item_reg, this->word_before.ptr());
+            else
+                this->update(word, loss, alpha, this->item_reg);
+        }
+};
+#endif
@@ -0,0 +1,812 @@
+#include <omp.h>
+#include <thread>
+#include "../util/checkpoint.h"
+#include "../util/progress.h"
+#include "../util/gemm.h"
+#include "../util/numa_topology.h"
+#include "../mapper/neighbor_mean_cache.h"
+#include "../mapper/hot_row_replicas.h"
+#include "tpr_step.h"
+#include "early_stopping.h"
+#include "tpr_trainer.h"
+
+TPRConfig::TPRConfig() {
+    this->save_name = "cse.embed";
+    this->save_format = "text";
+    this->aggregation = "sample";
+    this->dimension = 64;
+    this->num_negative = 5;
+    this->batch_size = 0;
+    this->partitions = 0;
+    this->bucket_passes = BUCKET_PASSES;
+    this->bucket_global = BUCKET_NEGATIVES;
+    this->interleave = TPR_INTERLEAVE;
+    this->samplers = 0;
+    this->ring_size = TPR_RING_SIZE;
+    this->hot_rows = 0;
+    this->hot_merge = HOT_ROW_MERGE;
+    this->update_times = 10;
+    this->init_alpha = 0.1;
+    this->schedule = SCHEDULE_LINEAR;
+    this->warmup = 0.05;
+    this->user_reg = 0.01;
+    this->item_reg = 0.01;
+    this->worker = 1;
+    this->numa = 0;
+    this->numa_simulate = 0;
+    this->table_placement = PLACEMENT_FIRST_TOUCH;
+    this->time_budget = 0;
+    this->valid_period = VALID_PERIOD;
+    this->patience = VALID_PATIENCE;
+    this->processes = 1;
+    this->rank = 0;
+    this->ps_sync = 0.05;
+    this->checkpoint_period = 0;
+    this->resume = 0;
+    this->table_advice = ADVICE_RANDOM;
+    this->table_sync = 0;
+    this->huge_page = 0;
+    this->update_rule = UPDATE_SGD;
+    this->mean_refresh = NEIGHBOR_MEAN_REFRESH;
+    this->pq_subspaces = 0;
+}
+
+std::string tpr_config_conflict(TPRConfig& config) {
+    int transport = !config.shm_name.empty() + !config.ps_serve.empty() + !config.ps_connect.empty();
+    if (config.save_format != "text" && config.save_format != "binary" && parse_quantization(config.save_format) == -1) {
+        return "unknown save format " + config.save_format;
+    }
+    if (config.aggregation != "sample" && config.aggregation != "mean") {
+        return "unknown aggregation " + config.aggregation;
+    }
+    if (config.hot_rows && (config.batch_size || config.aggregation != "sample")) {
+        // the mini-batch scatter and the word means write the table directly
+        return "-hot_rows needs -batch_size 0 and -aggregation sample";
+    }
+    if (config.partitions > 1 && (config.batch_size || config.samplers)) {
+        return "-partitions needs -batch_size 0 and -samplers 0";
+    }
+    if (config.partitions > 1 && config.partitions < config.worker) {
+        // every worker trains a bucket of its own in each round
+        return "-partitions must be at least -worker";
+    }
+    if (config.samplers && config.batch_size) {
+        return "-samplers needs -batch_size 0";
+    }
+    if (config.batch_size && config.aggregation != "sample") {
+        // a shared negative's batch-summed step would move every cached mean of its words
+        return "-batch_size needs -aggregation sample";
+    }
+    if (config.processes < 1 || config.rank < 0 || config.rank >= config.processes) {
+        return "-rank must be between 0 and -processes - 1";
+    }
+    if (transport > 1) {
+        return "-shm_name, -ps_serve and -ps_connect exclude each other";
+    }
+    if (transport && (!config.table_file.empty() || config.checkpoint_period || config.resume)) {
+        // the processes do not agree on a step to snapshot or resume at
+        return "-shm_name, -ps_serve and -ps_connect need no -table_file, -checkpoint_period or -resume";
+    }
+    if (!config.valid_ui.empty() && transport) {
+        // restoring one process's best rows would undo the others' updates
+        return "-valid_ui needs a single process";
+    }
+    if (config.processes > 1 && !transport) {
+        return "-processes needs -shm_name, -ps_serve or -ps_connect";
+    }
+    if (config.schedule == SCHEDULE_WARMUP && (config.warmup <= 0 || config.warmup >= 1)) {
+        return "-warmup must be between 0 and 1";
+    }
+    if (config.save_format == "pq" && config.pq_subspaces && (config.pq_subspaces < 0 || config.dimension % config.pq_subspaces)) {
+        // found out before training rather than when saving
+        return "-pq_subspaces must divide -dimension " + std::to_string(config.dimension);
+    }
+
+    if (config.checkpoint_name.empty())
+        config.checkpoint_name = config.save_name + ".ckpt";
+    // the largest divisor of the dimension up to dimension/4
+    if (!config.pq_subspaces)
+        for (config.pq_subspaces = config.dimension >= 4 ? config.dimension/4 : 1; config.dimension % config.pq_subspaces; config.pq_subspaces--);
+    config.partitions = config.partitions > 1 ? config.partitions : 0;
+    config.bucket_passes = config.bucket_passes > 0 ? config.bucket_passes : 1;
+    config.bucket_global = config.bucket_global < 0 ? 0 : (config.bucket_global > 1 ? 1 : config.bucket_global);
+    config.interleave = config.interleave > 0 ? config.interleave : 1;
+    // a sampler feeds at least one compute thread
+    config.samplers = config.samplers < 0 ? 0 : (config.samplers > config.worker ? config.worker : config.samplers);
+    config.ring_size = config.ring_size > 0 ? config.ring_size : 1;
+    config.numa_simulate = config.numa_simulate > 0 ? config.numa_simulate : 0;
+    config.time_budget = config.time_budget > 0 ? config.time_budget : 0;
+    config.valid_period = config.valid_period > 0 ? config.valid_period : VALID_PERIOD;
+    config.patience = config.patience > 0 ? config.patience : 0;
+    config.ps_sync = config.ps_sync > 0 ? config.ps_sync : 0.000001;
+    config.hot_merge = config.hot_merge > 0 ? config.hot_merge : 1;
+    return "";
+}
+
+int check_tpr_config(TPRConfig& config) {
+    std::string conflict = tpr_config_conflict(config);
+    if (!conflict.empty())
+        std::cout << conflict << std::endl;
+    return conflict.empty();
+}
+
+template<typename T>
+TPRTrainer<T>::TPRTrainer(const TPRConfig& config, std::string train_ui_path, std::string train_iw_path) {
+    this->config = config;
+    this->check_config();
+    std::cout << "(UI-Graph)" << std::endl;
+    this->ui_file_graph = new FileGraph(train_ui_path, 0);
+    std::cout << "(IW-Graph)" << std::endl;
+    try {
+        this->iw_file_graph = new FileGraph(train_iw_path, 0, this->ui_file_graph->index2node);
+    } catch (...) {
+        delete this->ui_file_graph;
+        throw;
+    }
+    this->build();
+}
+
+template<typename T>
+TPRTrainer<T>::TPRTrainer(const TPRConfig& config, const std::vector<std::string>& names, const EdgeArrays& ui, const EdgeArrays& iw) {
+    this->config = config;
+    this->check_config();
+    // the graphs copy the names
+    std::vector<char*> index2node(names.size());
+    for (size_t index=0; index<names.size(); index++)
+        index2node[index] = (char*)names[index].c_str();
+    std::cout << "(UI-Graph)" << std::endl;
+    this->ui_file_graph = new FileGraph(ui, 0, index2node);
+    std::cout << "(IW-Graph)" << std::endl;
+    try {
+        this->iw_file_graph = new FileGraph(iw, 0, index2node);
+    } catch (...) {
+        delete this->ui_file_graph;
+        throw;
+    }
+    this->build();
+}
+
+template<typename T>
+TPRTrainer<T>::TPRTrainer(const TPRConfig& config, const std::vector<std::string>& names, const CSRArrays& ui, const CSRArrays& iw) {
+    this->config = config;
+    this->check_config();
+    std::vector<char*> index2node(names.size());
+    for (size_t index=0; index<names.size(); index++)
+        index2node[index] = (char*)names[index].c_str();
+    std::cout << "(UI-Graph)" << std::endl;
+    this->ui_file_graph = new FileGraph(ui, 0, index2node);
+    std::cout << "(IW-Graph)" << std::endl;
+    try {
+        this->iw_file_graph = new FileGraph(iw, 0, index2node);
+    } catch (...) {
+        delete this->ui_file_graph;
+        throw;
+    }
+    this->build();
+}
+
+template<typename T>
+TPRTrainer<T>::~TPRTrainer() {
+    // the rows may live in the shared table
+    delete this->mapper;
+    delete this->shared_table;
+    delete this->bucket_sampler;
+    delete this->ui_sampler;
+    delete this->iw_sampler;
+    delete this->ui_file_graph;
+    delete this->iw_file_graph;
+}
+
+template<typename T>
+void TPRTrainer<T>::check_config() {
+    std::string conflict = tpr_config_conflict(this->config);
+    if (!conflict.empty())
+        throw std::invalid_argument(conflict);
+}
+
+template<typename T>
+void TPRTrainer<T>::build() {
+    // 1. [Sampler] determine what sampler to be used
+    this->ui_sampler = new VCSampler(this->ui_file_graph);
+    this->iw_sampler = new VCSampler(this->iw_file_graph);
+    this->bucket_sampler = NULL;
+    this->mapper = NULL;
+    this->shared_table = NULL;
+    try {
+        // partitions: the workers train disjoint (user part, item part) buckets
+        if (this->config.partitions)
+            this->bucket_sampler = new BucketSampler(this->ui_file_graph, this->config.partitions, this->config.bucket_global);
+
+        // 2. [Mapper] define what embedding mapper to be used
+        std::cout << "Embedding Precision: " << StorageTraits<T>::name() << std::endl;
+        this->mapper = new LookupMapper<T>(this->iw_sampler->vertex_size, this->config.dimension, this->config.huge_page, this->config.update_rule, this->config.table_file, this->config.table_advice);
+
+        // warm start: rows of a previous export, by name; new nodes stay random.
+        // With several processes the one that owns the rows loads them
+        if (!this->config.warm_start.empty() && this->config.rank == 0 && this->config.ps_connect.empty())
+            this->mapper->load_from_file(this->iw_file_graph, this->config.warm_start);
+    } catch (...) {
+        delete this->mapper;
+        delete this->bucket_sampler;
+        delete this->ui_sampler;
+        delete this->iw_sampler;
+        delete this->ui_file_graph;
+        delete this->iw_file_graph;
+        throw;
+    }
+}
+
+template<typename T>
+int TPRTrainer<T>::save() {
+    FileGraph& ui_file_graph = *this->ui_file_graph;
+    FileGraph& iw_file_graph = *this->iw_file_graph;
+    if (!this->config.table_file.empty())
+    {
+        // the table file is the binary output
+        this->mapper->save_table(&iw_file_graph);
+    }
+    if (this->config.save_format != "text")
+    {
+        // the item-word graph inherits the user-item node map, so its names cover both
+        std::vector<long> indexes = ui_file_graph.get_all_nodes();
+        std::vector<long> word_indexes = iw_file_graph.get_all_to_nodes();
+        indexes.insert(indexes.end(), word_indexes.begin(), word_indexes.end());
+        if (this->config.save_format != "binary")
+            return this->mapper->save_to_quantized(&iw_file_graph, indexes, this->config.save_name, parse_quantization(this->config.save_format), this->config.pq_subspaces);
+        else if (this->config.table_file.empty())
+            return this->mapper->save_to_binary(&iw_file_graph, indexes, this->config.save_name);
+    }
+    else
+    {
+        this->mapper->save_to_file(&ui_file_graph, ui_file_graph.get_all_nodes(), this->config.save_name, 0);
+        this->mapper->save_to_file(&iw_file_graph, iw_file_graph.get_all_to_nodes(), this->config.save_name, 1);
+    }
+    return 1;
+}
+
+template<typename T>
+long TPRTrainer<T>::index_of(std::string name) {
+    return this->iw_file_graph->node2index.search_key(&name[0]);
+}
+
+template<typename T>
+std::vector<typename TPRTrainer<T>::real> TPRTrainer<T>::vector(long index) {
+    std::vector<real> values(this->mapper->dimension);
+    for (int d=0; d<this->mapper->dimension; d++)
+        values[d] = this->mapper->get(index, d);
+    return values;
+}
+
+template<typename T>
+int TPRTrainer<T>::train() {
+    // common dimensions get fully unrolled kernels, the others the generic ones
+    switch (this->config.dimension)
+    {
+        case 16: return this->template train_dimension<16>();
+        case 32: return this->template train_dimension<32>();
+        case 64: return this->template train_dimension<64>();
+        case 128: return this->template train_dimension<128>();
+        case 256: return this->template train_dimension<256>();
+        default: return this->template train_dimension<0>();
+    }
+}
+
+template<typename T>
+template<int DIM>
+VECTOR_KERNEL_CLONES
+int TPRTrainer<T>::train_dimension() {
+
+    TPRConfig& config = this->config;
+    FileGraph& ui_file_graph = *this->ui_file_graph;
+    FileGraph& iw_file_graph = *this->iw_file_graph;
+    VCSampler& ui_sampler = *this->ui_sampler;
+    VCSampler& iw_sampler = *this->iw_sampler;
+    LookupMapper<T>& i_mapper = *this->mapper;
+    std::string save_name = config.save_name;
+    int dimension = config.dimension;
+    int num_negative = config.num_negative;
+    int batch_size = config.batch_size;
+    double update_times = config.update_times;
+    double init_alpha = config.init_alpha;
+    real user_reg = config.user_reg;
+    real item_reg = config.item_reg;
+    int worker = config.worker;
+
+    std::cout << "Embedding Kernels: " << (DIM ? "dimension-specialized" : "generic") << std::endl;
+
+    // several processes: the parameter server only holds the rows, which its
+    // clients pull, train on and push back; processes on one host can share
+    // the rows in shared memory instead
+    if (!config.ps_serve.empty())
+    {
+        ParameterServer<T> server(&i_mapper, config.ps_serve, config.processes);
+        unsigned long long served = server.serve();
+        std::cout << "\t" << served << " updates made by the clients" << std::endl;
+        return 1;
+    }
+    // held-out edges, read before anything is started that a bad file would leave behind
+    std::vector<ValidationPair> valid_pairs;
+    if (!config.valid_ui.empty())
+        valid_pairs = read_validation_pairs(config.valid_ui, &ui_file_graph, ui_file_graph.get_all_to_nodes());
+    if (!config.shm_name.empty())
+    {
+        this->shared_table = new SharedTable(config.shm_name, i_mapper.bytes(), config.processes, config.rank);
+        if (config.rank == 0)
+        {
+            i_mapper.attach((T*)this->shared_table->rows, 1);
+            this->shared_table->ready();
+        }
+        else
+        {
+            this->shared_table->wait_ready();
+            i_mapper.attach((T*)this->shared_table->rows, 0);
+        }
+        std::cout << "Shared Table: <" << this->shared_table->name << "> rank " << config.rank << " of " << config.processes << std::endl;
+    }
+    // checkpoint: resume from the last one before the means are built from the
+    // rows; a client keeps the step count, and pulls the rows from the server
+    unsigned long long total_update_times = update_times*1000000;
+    unsigned long long finished_update_times = 0;
+    CheckpointHeader checkpoint_header = make_checkpoint_header(StorageTraits<T>::precision(), config.update_rule, i_mapper.size, dimension, i_mapper.stride, i_mapper.bytes());
+    if (config.resume && load_checkpoint(config.checkpoint_name, checkpoint_header, i_mapper.embedding))
+        finished_update_times = checkpoint_header.step < total_update_times ? checkpoint_header.step : total_update_times;
+    ParameterClient<T>* ps_client = NULL;
+    if (!config.ps_connect.empty())
+        ps_client = new ParameterClient<T>(&i_mapper, config.ps_connect);
+    std::string ps_failure;
+    unsigned long long ps_sync_period = config.ps_sync*1000000;
+    unsigned long long next_ps_sync = ps_sync_period;
+
+    // items aggregate all their words through cached means, or one sampled word
+    NeighborMeanCache<T>* word_means = NULL;
+    if (config.aggregation == "mean")
+        word_means = new NeighborMeanCache<T>(&iw_file_graph, &i_mapper, config.mean_refresh);
+
+    // then snapshot every checkpoint_period
+    Checkpointer checkpointer(config.checkpoint_name, checkpoint_header, i_mapper.embedding);
+    unsigned long long checkpoint_period = config.checkpoint_period*1000000;
+    unsigned long long next_checkpoint = finished_update_times + checkpoint_period;
+    unsigned long long table_sync_period = config.table_sync*1000000;
+    unsigned long long next_table_sync = finished_update_times + table_sync_period;
+
+    // numa: workers are pinned to the CPUs of their node, and every node
+    // samples from its own copies of the samplers, made by a thread on the node
+    NumaTopology* topology = NULL;
+    std::vector<VCSampler*> node_ui_samplers, node_iw_samplers;
+    if (config.numa || config.table_placement != PLACEMENT_FIRST_TOUCH)
+    {
+        topology = new NumaTopology(config.numa_simulate);
+        std::cout << "NUMA: " << topology->describe() << std::endl;
+        if (topology->place(i_mapper.embedding, i_mapper.bytes(), config.table_placement) != 0)
+            std::cout << "NUMA: cannot place the table, its pages stay where they were touched" << std::endl;
+    }
+    if (config.numa)
+    {
+        node_ui_samplers.resize(topology->nodes());
+        node_iw_samplers.resize(topology->nodes());
+        std::vector<std::thread> copiers;
+        for (int node=0; node<topology->nodes(); node++)
+        {
+            copiers.push_back(std::thread([&, node]() {
+                topology->pin_thread(node);
+                node_ui_samplers[node] = new VCSampler(ui_sampler);
+                node_iw_samplers[node] = new VCSampler(iw_sampler);
+            }));
+        }
+        for (int node=0; node<topology->nodes(); node++)
+            copiers[node].join();
+        std::cout << "NUMA: samplers replicated on " << topology->nodes() << " nodes" << std::endl;
+    }
+
+    // hot rows: each worker updates its own replicas of the rows with the
+    // largest degree and merges them into the table every hot_merge updates
+    std::vector<long> hot_rows;
+    std::vector<int> hot_slots;
+    if (config.hot_rows)
+    {
+        std::vector<double> degrees = iw_file_graph.get_degrees();
+        std::vector<double> ui_degrees = ui_file_graph.get_degrees();
+        for (long index=0; index<(long)ui_degrees.size(); index++)
+            degrees[index] += ui_degrees[index];
+        degrees.resize(i_mapper.size, 0.0);
+        hot_rows = top_rows(degrees, config.hot_rows);
+        hot_slots = row_slots(i_mapper.size, hot_rows);
+        std::cout << "Hot Rows: " << hot_rows.size() << " replicated per worker" << std::endl;
+    }
+
+    // telemetry: every worker adds to its own running sums, worker 0 reports
+    // the window since its last report
+    std::vector<TrainingStats> worker_stats(worker);
+    TrainingStats reported_stats;
+
+    // progress: the global step is the sum of the workers' own counters, and
+    // the learning rate follows the schedule over it
+    ProgressCounters progress(worker, finished_update_times);
+    std::vector<double> worker_rates, worker_seconds(worker), worker_waiting(worker, 0.0);
+
+    // the remaining updates, split as evenly as the count allows
+    std::vector<unsigned long long> worker_updates(worker);
+    for (int w=0; w<worker; w++)
+        worker_updates[w] = (total_update_times-finished_update_times)/worker
+                          + (w < (int)((total_update_times-finished_update_times)%worker));
+
+    // partitions: the workers train disjoint (user part, item part) buckets
+    // round by round, with the negatives drawn in the bucket, so the rows a
+    // worker touches are a few parts of the table instead of all of it
+    BucketSampler* bucket_sampler = this->bucket_sampler;
+    BucketRounds* bucket_rounds = NULL;
+    if (bucket_sampler)
+    {
+        bucket_rounds = new BucketRounds(*bucket_sampler, worker, config.bucket_passes, total_update_times-finished_update_times);
+        worker_updates = bucket_rounds->worker_updates;
+    }
+
+    // stopping early: the time budget, which the learning rate schedule is
+    // stretched over, or a validation plateau; samples drawn ahead are dropped
+    std::atomic<int> stop_training(0);
+
+    // pipeline: sampler thread s draws the samples of every worker w with
+    // w % samplers == s into that worker's ring, so compute workers only run
+    // the step
+    std::vector<SPSCRing<TPRSample>*> rings;
+    std::vector<std::thread> sampler_threads;
+    std::vector<unsigned long long> sampler_samples(config.samplers, 0);
+    std::vector<double> sampler_waiting(config.samplers, 0.0), sampler_seconds(config.samplers, 0.0);
+    if (config.samplers)
+    {
+        std::cout << "Pipeline: " << config.samplers << " sampler threads feeding " << worker << " compute threads" << std::endl;
+        TPRSample prototype;
+        prototype.pairs.resize(num_negative);
+        for (int w=0; w<worker; w++)
+            rings.push_back(new SPSCRing<TPRSample>(config.ring_size, prototype));
+        for (int s=0; s<config.samplers; s++)
+        {
+            sampler_threads.push_back(std::thread([&, s]() {
+                std::vector<SPSCRing<TPRSample>*> own_rings;
+                std::vector<unsigned long long> own_counts;
+                for (int w=s; w<worker; w+=config.samplers)
+                {
+                    own_rings.push_back(rings[w]);
+                    own_counts.push_back(worker_updates[w]);
+                    sampler_samples[s] += worker_updates[w];
+                }
+                // a sampler sits on the node of the first worker it feeds
+                int node = config.numa ? topology->node_of_worker(s, worker) : 0;
+                if (config.numa)
+                    topology->pin_thread(node);
+                VCSampler& node_ui_sampler = config.numa ? *node_ui_samplers[node] : ui_sampler;
+                VCSampler& node_iw_sampler = config.numa ? *node_iw_samplers[node] : iw_sampler;
+                double start = omp_get_wtime();
+                sampler_waiting[s] = produce_tpr_samples(node_ui_sampler, node_iw_sampler, num_negative, word_means != NULL, own_rings, own_counts, &stop_training);
+                sampler_seconds[s] = omp_get_wtime() - start;
+            }));
+        }
+    }
+
+    // validation: a background thread scores held-out edges and keeps the best rows
+    EarlyStopping<T>* early_stopping = NULL;
+    if (!config.valid_ui.empty())
+        early_stopping = new EarlyStopping<T>(&i_mapper, valid_pairs, config.valid_period, config.patience, &stop_training);
+    if (config.time_budget)
+        std::cout << "Time Budget: " << config.time_budget << " s" << std::endl;
+    double train_start = omp_get_wtime();
+
+    // 4. building the blocks [MF]
+    std::cout << "Start Training:" << std::endl;
+    Monitor monitor(total_update_times);
+
+    omp_set_num_threads(worker);
+    #pragma omp parallel for
+    for (int w=0; w<worker; w++)
+    {
+        // pinned first, so that everything the worker allocates is local
+        int node = config.numa ? topology->node_of_worker(w, worker) : 0;
+        if (config.numa && topology->pin_thread(node) != 0)
+            printf("NUMA: cannot pin worker %d to node %d\n", w, node);
+        VCSampler& worker_ui_sampler = config.numa ? *node_ui_samplers[node] : ui_sampler;
+        VCSampler& worker_iw_sampler = config.numa ? *node_iw_samplers[node] : iw_sampler;
+        // 3. [Optimizer] one fused margin BPR step per sample (tpr_step.h)
+        // samples drawn ahead of the step, their rows prefetched
+        std::vector<TPRSample> window(config.interleave);
+        unsigned long long drawn = 0;
+        BucketCursor bucket_cursor;
+        HotRowReplicas<T>* replicas = NULL;
+        if (!hot_rows.empty())
+            replicas = new HotRowReplicas<T>(&i_mapper, hot_rows, hot_slots);
+        TrainingStats& stats = worker_stats[w];
+        TPRStep<T, DIM> tpr_step(&i_mapper, word_means, replicas, &stats, user_reg, item_reg);
+        unsigned long long worker_update_times = worker_updates[w];
+        unsigned long long update=0, reported=0, published=0, merged=0, report_period = 10000;
+        real alpha = scheduled_alpha(config.schedule, init_alpha, (double)finished_update_times/total_update_times, config.warmup);
+        double start_time = omp_get_wtime();
+
+        // mini-batch: batch_size (user, positive) pairs share num_negative negatives,
+        // [item, word] lists
+        std::vector<long> batch_users, batch_given;
+        std::vector<std::vector<long> > batch_pos_words(batch_size), batch_neg_words(num_negative);
+        std::vector<real> batch_user_embed, batch_pos_embed, batch_neg_embed, batch_scores, batch_user_loss, batch_neg_loss;
+        DimVector<real, DIM> batch_pos_loss(dimension);
+        if (batch_size)
+        {
+            batch_users.resize(batch_size);
+            batch_given.resize(batch_size);
+            batch_user_embed.resize((long)batch_size*dimension);
+            batch_pos_embed.resize((long)batch_size*dimension);
+            batch_neg_embed.resize((long)num_negative*dimension);
+            batch_scores.resize((long)batch_size*num_negative);
+            batch_user_loss.resize((long)batch_size*dimension);
+            batch_neg_loss.resize((long)num_negative*dimension);
+        }
+
+        while (update < worker_update_times)
+        {
+            if (batch_size)
+            {
+                // the last batch only makes the worker's remaining updates
+                int batch = worker_update_times - update < (unsigned long long)batch_size ? (int)(worker_update_times - update) : batch_size;
+                // gather: users, their positives and the shared negatives, packed row by row
+                for (int b=0; b<batch; b++)
+                {
+                    long pair[2];
+                    pair[0] = batch_users[b] = worker_ui_sampler.draw_a_vertex();
+                    pair[1] = batch_given[b] = worker_ui_sampler.draw_a_context(pair[0]);
+                    i_mapper.template textgcn_embedding<DIM>(pair, 2, batch_user_embed.data() + (long)b*dimension);
+
+                    std::vector<long>& words = batch_pos_words[b];
+                    words.clear();
+                    words.push_back(worker_ui_sampler.draw_a_context(pair[0]));
+                    worker_iw_sampler.feed_sampled_contexts(pair[1], 1, words);
+                    i_mapper.template textgcn_embedding<DIM>(words.data(), words.size(), batch_pos_embed.data() + (long)b*dimension);
+                }
+                for (int k=0; k<num_negative; k++)
+                {
+                    std::vector<long>& words = batch_neg_words[k];
+                    words.clear();
+                    words.push_back(worker_ui_sampler.draw_a_context_uniformly());
+                    worker_iw_sampler.feed_sampled_contexts(words[0], 1, words);
+                    i_mapper.template textgcn_embedding<DIM>(words.data(), words.size(), batch_neg_embed.data() + (long)k*dimension);
+                }
+
+                // scores[b][k] = user_b.neg_k, turned in place into the margin BPR gradient g_bk
+                std::fill(batch_scores.begin(), batch_scores.end(), (real)0);
+                gemm_nt<real>(batch, num_negative, dimension, 1, batch_user_embed.data(), dimension, batch_neg_embed.data(), dimension, batch_scores.data(), num_negative);
+                // a user and its positive take the mean over the shared negatives, a
+                // negative the sum over the batch, as if it was drawn for every pair
+                for (int b=0; b<batch; b++)
+                {
+                    real* user_row = batch_user_embed.data() + (long)b*dimension;
+                    real* pos_row = batch_pos_embed.data() + (long)b*dimension;
+                    real* user_loss_row = batch_user_loss.data() + (long)b*dimension;
+                    real pos_score = dim_dot<DIM>(user_row, pos_row, dimension);
+                    real gradient = 0;
+                    int record = b % TELEMETRY_PERIOD == 0;
+                    for (int k=0; k<num_negative; k++)
+                    {
+                        real& score = batch_scores[(long)b*num_negative + k];
+                        score = fast_sigmoid(-(pos_score - score - TPR_MARGIN));
+                        if (record)
+                            stats.add_pair(-std::log(1 - score), score);
+                        gradient += score;
+                    }
+                    gradient /= num_negative;
+                    // positive: mean_k g_bk * user_b
+                    dim_zero<DIM>(batch_pos_loss.ptr(), dimension);
+                    dim_axpy<DIM>(gradient, user_row, batch_pos_loss.ptr(), dimension);
+                    for (auto it=batch_pos_words[b].begin(); it!=batch_pos_words[b].end(); it++)
+                        i_mapper.template update_with_l2<DIM>(*it, batch_pos_loss.ptr(), alpha, item_reg);
+                    // user: mean_k g_bk * (pos_b - neg_k), the negatives by GEMM below
+                    dim_zero<DIM>(user_loss_row, dimension);
+                    dim_axpy<DIM>(gradient, pos_row, user_loss_row, dimension);
+                }
+                gemm_nn<real>(batch, dimension, num_negative, (real)-1/num_negative, batch_scores.data(), num_negative, batch_neg_embed.data(), dimension, batch_user_loss.data(), dimension);
+                // negative: -sum_b g_bk * user_b
+                std::fill(batch_neg_loss.begin(), batch_neg_loss.end(), (real)0);
+                gemm_tn<real>(num_negative, dimension, batch, -1, batch_scores.data(), num_negative, batch_user_embed.data(), dimension, batch_neg_loss.data(), dimension);
+
+                // scatter the sparse updates back to the table
+                for (int k=0; k<num_negative; k++)
+                    for (auto it=batch_neg_words[k].begin(); it!=batch_neg_words[k].end(); it++)
+                        i_mapper.template update_with_l2<DIM>(*it, batch_neg_loss.data() + (long)k*dimension, alpha, item_reg);
+                for (int b=0; b<batch; b++)
+                {
+                    i_mapper.template update_with_l2<DIM>(batch_users[b], batch_user_loss.data() + (long)b*dimension, alpha, user_reg);
+                    i_mapper.template update_with_l2<DIM>(batch_given[b], batch_user_loss.data() + (long)b*dimension, alpha, user_reg);
+                    // the norms of the rows just written
+                    if (b % TELEMETRY_PERIOD == 0)
+                    {
+                        stats.add_row(i_mapper.norm(i_mapper.row(batch_users[b])));
+                        stats.add_row(i_mapper.norm(i_mapper.row(batch_given[b])));
+                    }
+                }
+                update += batch;
+            }
+            else if (config.samplers)
+            {
+                // the sampler thread already drew it; wait while the ring is empty,
+                // unless a stop made the sampler quit
+                TPRSample* ready = rings[w]->consume_slot();
+                if (!ready)
+                {
+                    double wait_start = omp_get_wtime();
+                    while (!(ready = rings[w]->consume_slot()) && !stop_training.load(std::memory_order_relaxed))
+                        std::this_thread::yield();
+                    worker_waiting[w] += omp_get_wtime() - wait_start;
+                    if (!ready)
+                        break;
+                }
+                tpr_step.step(*ready, alpha);
+                rings[w]->consume();
+                update++;
+                if (replicas && update - merged >= (unsigned long long)config.hot_merge)
+                {
+                    replicas->merge();
+                    merged = update;
+                }
+            }
+            else
+            {
+                // the positive's word comes from item_given, or from the positive with word means;
+                // interleave-1 samples stay drawn ahead, so the misses on their rows
+                // overlap with the steps before them
+                while (drawn < worker_update_times && drawn - update < window.size())
+                {
+                    TPRSample& ahead = window[drawn % window.size()];
+                    if (bucket_rounds)
+                    {
+                        int bucket = bucket_rounds->next(w, bucket_cursor, &stop_training);
+                        if (bucket < 0)
+                            break;
+                        draw_tpr_bucket_sample(*bucket_sampler, bucket, worker_iw_sampler, num_negative, word_means != NULL, ahead);
+                    }
+                    else
+                        draw_tpr_sample(worker_ui_sampler, worker_iw_sampler, num_negative, word_means != NULL, ahead);
+                    if (window.size() > 1)
+                        tpr_step.prefetch(ahead);
+                    drawn++;
+                }
+                // stopped while waiting for the other workers' buckets
+                if (update == drawn)
+                    break;
+                tpr_step.step(window[update % window.size()], alpha);
+                update++;
+                if (replicas && update - merged >= (unsigned long long)config.hot_merge)
+                {
+                    replicas->merge();
+                    merged = update;
+                }
+            }
+
+            // 5. print progress, from counts published much more often than reported
+            if (update - published >= PROGRESS_PUBLISH)
+            {
+                published = update;
+                progress.set(w, update);
+            }
+            if (update - reported >= report_period || update >= worker_update_times) {
+                reported = update;
+                published = update;
+                progress.set(w, update);
+                unsigned long long global_update_times = progress.total();
+                double fraction = (double)global_update_times/total_update_times;
+                double elapsed = omp_get_wtime() - train_start;
+                if (config.time_budget && elapsed/config.time_budget > fraction)
+                    fraction = elapsed/config.time_budget;
+                alpha = scheduled_alpha(config.schedule, init_alpha, fraction, config.warmup);
+                if (w == 0)
+                {
+                    TrainingStats window;
+                    for (int s=0; s<worker; s++)
+                        window.add(worker_stats[s]);
+                    TrainingStats total = window;
+                    window.subtract(reported_stats);
+                    reported_stats = total;
+                    progress.window_rates(worker_rates);
+                    monitor.progress(&global_update_times, window, worker_rates);
+                }
+                if (w == 0 && checkpoint_period && global_update_times >= next_checkpoint)
+                {
+                    // skipped while the previous snapshot is still being written
+                    if (checkpointer.request(global_update_times, alpha))
+                        next_checkpoint = global_update_times + checkpoint_period;
+                }
+                if (w == 0 && ps_client && global_update_times >= next_ps_sync)
+                {
+                    // the other workers go on meanwhile; an exception cannot
+                    // leave the parallel region, so a lost server stops them
+                    try {
+                        ps_client->sync();
+                    } catch (const std::exception& error) {
+                        ps_failure = error.what();
+                        stop_training.store(1);
+                    }
+                    next_ps_sync = global_update_times + ps_sync_period;
+                }
+                if (w == 0 && table_sync_period && global_update_times >= next_table_sync)
+                {
+                    // start writing dirty rows back without waiting for them
+                    i_mapper.sync(0);
+                    next_table_sync = global_update_times + table_sync_period;
+                }
+                // every worker stops at its next report
+                if (config.time_budget && elapsed >= config.time_budget)
+                    stop_training.store(1);
+                if (stop_training.load(std::memory_order_relaxed))
+                    break;
+            }
+        }
+        progress.set(w, update);
+        worker_seconds[w] = omp_get_wtime() - start_time;
+        if (bucket_rounds)
+            bucket_rounds->leave(bucket_cursor);
+        if (replicas)
+        {
+            replicas->merge();
+            delete replicas;
+        }
+    }
+    for (size_t s=0; s<sampler_threads.size(); s++)
+        sampler_threads[s].join();
+    for (size_t w=0; w<rings.size(); w++)
+        delete rings[w];
+    monitor.end();
+    delete bucket_rounds;
+    if (stop_training.load())
+        std::cout << "Stopped after " << progress.total() << " of " << total_update_times << " updates" << std::endl;
+    if (early_stopping)
+    {
+        early_stopping->finish();
+        delete early_stopping;
+    }
+    // stragglers show up as a lower rate than the others; in the pipeline,
+    // waiting compute threads mean too few samplers and waiting samplers too many
+    for (int w=0; w<worker; w++)
+    {
+        printf("\tWorker %d:\t%llu updates\t%.1f K/s", w, progress.get(w), progress.get(w)/worker_seconds[w]/1000.0);
+        if (config.samplers)
+            printf("\t%.1f %% waiting for samples", 100.0*worker_waiting[w]/worker_seconds[w]);
+        printf("\n");
+    }
+    for (int s=0; s<config.samplers; s++)
+        printf("\tSampler %d:\t%llu samples\t%.1f %% waiting on full rings\n", s, sampler_samples[s], 100.0*sampler_waiting[s]/sampler_seconds[s]);
+    delete word_means;
+    for (size_t node=0; node<node_ui_samplers.size(); node++)
+    {
+        delete node_ui_samplers[node];
+        delete node_iw_samplers[node];
+    }
+    delete topology;
+    if (ps_client)
+    {
+        // last push, then the server saves what everyone trained
+        try {
+            if (!ps_failure.empty())
+                throw std::runtime_error(ps_failure);
+            ps_client->sync();
+        } catch (...) {
+            delete ps_client;
+            throw;
+        }
+        ps_client->done(progress.total() - finished_update_times);
+        delete ps_client;
+        std::cout << "Parameter Client: the output is saved by the server" << std::endl;
+        return 0;
+    }
+    if (this->shared_table)
+    {
+        // rank 0 saves once every process is done; the rows stay mapped
+        // until the trainer goes
+        int missing = this->shared_table->finish();
+        if (missing)
+            std::cout << "Shared Table: " << missing << " processes did not finish in " << SHARED_TABLE_FINISH_WAIT << " seconds, saving without the rest of their updates" << std::endl;
+        if (config.rank != 0)
+        {
+            std::cout << "Shared Table: the output is saved by rank 0" << std::endl;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+template class TPRTrainer<double>;
+template class TPRTrainer<float>;
+template class TPRTrainer<bfloat16>;
@@ -0,0 +1,96 @@
+#ifndef TPR_TRAINER_H
+#define TPR_TRAINER_H
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../util/file_graph.h"
+#include "../sampler/vc_sampler.h"
+#include "../sampler/bucket_sampler.h"
+#include "../mapper/lookup_mapper.h"
+#include "../mapper/shared_table.h"
+
+struct TPRConfig {
+    /* TPRConfig holds every knob of TPRTrainer; the constructor sets the
+     * defaults of the matching tpr flags, e.g. `dimension` is -dimension.
+     * Names (schedule, update_rule, ...) are already parsed into their ids.
+     * update_times is this process's share, in millions of updates.
+     */
+    std::string save_name, save_format, checkpoint_name, warm_start, table_file, aggregation, shm_name, ps_serve, ps_connect, valid_ui;
+    int dimension, num_negative, batch_size, partitions, bucket_passes, interleave, samplers, ring_size, hot_rows, hot_merge, schedule, patience, worker, numa, numa_simulate, table_placement, processes, rank, huge_page, update_rule, resume, table_advice, pq_subspaces;
+    double update_times, init_alpha, warmup, user_reg, item_reg, checkpoint_period, table_sync, ps_sync, bucket_global, time_budget, valid_period;
+    unsigned int mean_refresh;
+
+    TPRConfig();
+};
+
+// clamp the knobs into range; returns the first conflict between them, or
+// "" if there is none
+std::string tpr_config_conflict(TPRConfig& config);
+// the same, printing the conflict; returns 0 if there is one
+int check_tpr_config(TPRConfig& config);
+
+template<typename T>
+class TPRTrainer {
+    /* TPRTrainer is tpr without the command line: it builds the graphs, the
+     * samplers and the table, trains, and saves what tpr saves. The graphs
+     * come from edge list files, or from memory (EdgeArrays or CSRArrays of
+     * indexes into `names`) without writing or parsing any text; users and
+     * items are the nodes of `ui`, items and words those of `iw`.
+     * The trained rows stay in `mapper` for as long as the trainer lives:
+     * row(index_of(name)) has the node's `dimension` values in storage type
+     * T, and embedding() is the whole row-major matrix, `stride` elements
+     * per row.
+     */
+    public:
+        typedef typename StorageTraits<T>::real real;
+
+        //variable
+        TPRConfig config;
+        FileGraph* ui_file_graph;
+        FileGraph* iw_file_graph;
+        VCSampler* ui_sampler;
+        VCSampler* iw_sampler;
+        LookupMapper<T>* mapper;
+
+        // constructor; throws std::invalid_argument with the conflict on a
+        // bad config or on more partitions than users or items,
+        // std::out_of_range on an edge of a node not in names, and
+        // std::runtime_error on a graph path or warm_start file that cannot
+        // be read
+        TPRTrainer(const TPRConfig& config, std::string train_ui_path, std::string train_iw_path);
+        TPRTrainer(const TPRConfig& config, const std::vector<std::string>& names, const EdgeArrays& ui, const EdgeArrays& iw);
+        TPRTrainer(const TPRConfig& config, const std::vector<std::string>& names, const CSRArrays& ui, const CSRArrays& iw);
+        ~TPRTrainer();
+        TPRTrainer(const TPRTrainer&) = delete;
+        TPRTrainer& operator=(const TPRTrainer&) = delete;
+
+        // returns 1 when this process holds the trained rows, 0 when another
+        // process of a shared table or the parameter server saves them;
+        // throws std::runtime_error on a validation file or checkpoint that
+        // cannot be read, and when the shared table or the parameter server
+        // fails
+        int train();
+        // the outputs of config.save_name, save_format and table_file;
+        // returns 0 when one could not be written
+        int save();
+
+        // embedding access
+        T* embedding() { return this->mapper->embedding; }
+        T* row(long index) { return this->mapper->row(index); }
+        long stride() { return this->mapper->stride; }
+        int dimension() { return this->mapper->dimension; }
+        long size() { return this->mapper->size; }
+        // the row of a node name, -1 if unknown
+        long index_of(std::string name);
+        std::vector<real> vector(long index);
+
+    private:
+        BucketSampler* bucket_sampler;
+        SharedTable* shared_table;
+        void check_config();
+        void build();
+        template<int DIM>
+        int train_dimension();
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include "checkpoint.h"
+#include "memory.h"
+
+CheckpointHeader make_checkpoint_header(int precision, int update_rule, long size, int dimension, long stride, size_t bytes) {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.precision = precision;
+    header.update_rule = update_rule;
+    header.dimension = dimension;
+    header.size = size;
+    header.stride = stride;
+    header.bytes = bytes;
+    return header;
+}
+
+int load_checkpoint(std::string path, CheckpointHeader& header, void* buffer) {
+    std::cout << "Load Checkpoint:" << std::endl;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cout << "\tno checkpoint at <" << path << ">" << std::endl;
+        return 0;
+    }
+    CheckpointHeader saved;
+    if (fread(&saved, sizeof(saved), 1, file) != 1
+        || memcmp(saved.magic, header.magic, sizeof(saved.magic))
+        || saved.version != header.version
+        || saved.precision != header.precision
+        || saved.update_rule != header.update_rule
+        || saved.dimension != header.dimension
+        || saved.size != header.size
+        || saved.stride != header.stride
+        || saved.bytes != header.bytes)
+    {
+        fclose(file);
+        throw std::runtime_error("checkpoint <" + path + "> does not match this model");
+    }
+    if (fread(buffer, 1, saved.bytes, file) != saved.bytes)
+    {
+        fclose(file);
+        throw std::runtime_error("checkpoint <" + path + "> is truncated");
+    }
+    fclose(file);
+    header.step = saved.step;
+    header.alpha = saved.alpha;
+    std::cout << "\tresume from step " << saved.step << " <" << path << ">" << std::endl;
+    return 1;
+}
+
+Checkpointer::Checkpointer(std::string path, CheckpointHeader header, const void* buffer) {
+    this->path = path;
+    this->header = header;
+    this->buffer = buffer;
+    this->snapshot = NULL;
+    this->pending = 0;
+    this->stopping = 0;
+    this->writer = std::thread(&Checkpointer::write_loop, this);
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = 1;
+    }
+    this->signal.notify_all();
+    this->writer.join();
+    release_aligned(this->snapshot, this->header.bytes, 0);
+}
+
+int Checkpointer::request(unsigned long long step, double alpha) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->pending)
+            return 0;
+    }
+    // the writer only touches the snapshot while pending is set
+    if (this->snapshot == NULL)
+        this->snapshot = allocate_aligned(this->header.bytes, 0);
+    memcpy(this->snapshot, this->buffer, this->header.bytes);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->header.step = step;
+        this->header.alpha = alpha;
+        this->pending = 1;
+    }
+    this->signal.notify_all();
+    return 1;
+}
+
+void Checkpointer::wait() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->signal.wait(lock, [this]{ return !this->pending; });
+}
+
+void Checkpointer::write_loop() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+        this->signal.wait(lock, [this]{ return this->pending || this->stopping; });
+        if (!this->pending)
+            return;
+        CheckpointHeader header = this->header;
+        lock.unlock();
+
+        std::string temp_path = this->path + ".tmp";
+        FILE* file = fopen(temp_path.c_str(), "wb");
+        int written = file
+            && fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(this->snapshot, 1, header.bytes, file) == header.bytes;
+        if (file && fclose(file) != 0)
+            written = 0;
+        if (!written || rename(temp_path.c_str(), this->path.c_str()) != 0)
+            std::cout << "\n\tfail to write checkpoint <" << this->path << ">" << std::endl;
+
+        lock.lock();
+        this->pending = 0;
+        this->signal.notify_all();
+    }
+}
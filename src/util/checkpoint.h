@@ -0,0 +1,70 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <stdint.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define CHECKPOINT_MAGIC "SMORECKP"
+#define CHECKPOINT_VERSION 1
+
+/* Checkpoint file: this header followed by the raw embedding buffer
+ * (`bytes` bytes, rows of `stride` elements including optimizer state).
+ */
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t precision;         // PRECISION_*
+    uint32_t update_rule;       // UPDATE_*
+    uint32_t dimension;
+    uint64_t size;
+    uint64_t stride;
+    uint64_t bytes;
+    uint64_t step;              // finished updates
+    double alpha;               // learning rate at step
+};
+
+CheckpointHeader make_checkpoint_header(int precision, int update_rule, long size, int dimension, long stride, size_t bytes);
+
+// reads the checkpoint at path into buffer if its layout matches header,
+// filling header.step and header.alpha; returns 1 on success, 0 if there is
+// no checkpoint; throws std::runtime_error if there is one that does not
+// match, or that is truncated
+int load_checkpoint(std::string path, CheckpointHeader& header, void* buffer);
+
+class Checkpointer {
+    /* Checkpointer writes snapshots of a buffer from a background thread.
+     * request() copies the buffer into a second one and returns, so the
+     * trainer only pauses for a memcpy; under lock-free updates the copy is
+     * fuzzy, like the training itself. The thread writes the copy to
+     * <path>.tmp and renames it over <path>, so a crash never leaves a torn
+     * checkpoint behind.
+     */
+    public:
+        std::string path;
+        CheckpointHeader header;
+        const void* buffer;
+
+        // constructor
+        Checkpointer(std::string path, CheckpointHeader header, const void* buffer);
+        ~Checkpointer();
+        Checkpointer(const Checkpointer&) = delete;
+        Checkpointer& operator=(const Checkpointer&) = delete;
+
+        // snapshot now; returns 0 (and skips) while the previous one is being written
+        int request(unsigned long long step, double alpha);
+        // block until the pending snapshot is on disk
+        void wait();
+
+    private:
+        void* snapshot;
+        int pending, stopping;
+        std::mutex mutex;
+        std::condition_variable signal;
+        std::thread writer;
+        void write_loop();
+};
+
+#endif
@@ -9,6 +9,50 @@ FileGraph::FileGraph(std::string path, int undirected, std::vector<char*>& index
     this->load_from_edge_list(path, undirected);
 }
 
+FileGraph::FileGraph(const EdgeArrays& edges, int undirected, std::vector<char*>& index2node) {
+    for (long e=0; e<edges.edge_size; e++)
+    {
+        check_index(edges.from[e], index2node.size());
+        check_index(edges.to[e], index2node.size());
+    }
+    this->inherit_index2node(index2node);
+    std::cout << "Loading Edges:" << std::endl;
+    for (long e=0; e<edges.edge_size; e++)
+        this->add_edge(edges.from[e], edges.to[e], edges.weights ? edges.weights[e] : 1.0, undirected);
+    this->edge_size = edges.edge_size;
+    std::cout << "\t# of edge:\t" << this->edge_size << std::endl;
+    std::cout << "\t# of node:\t" << this->index2node.size() << std::endl;
+}
+
+FileGraph::FileGraph(const CSRArrays& csr, int undirected, std::vector<char*>& index2node) {
+    if (csr.num_rows)
+        check_index(csr.num_rows - 1, index2node.size());
+    for (long row=0; row<csr.num_rows; row++)
+        for (long e=csr.offsets[row]; e<csr.offsets[row+1]; e++)
+            check_index(csr.columns[e], index2node.size());
+    this->inherit_index2node(index2node);
+    std::cout << "Loading CSR:" << std::endl;
+    for (long row=0; row<csr.num_rows; row++)
+        for (long e=csr.offsets[row]; e<csr.offsets[row+1]; e++)
+            this->add_edge(row, csr.columns[e], csr.weights ? csr.weights[e] : 1.0, undirected);
+    this->edge_size = csr.num_rows ? csr.offsets[csr.num_rows] - csr.offsets[0] : 0;
+    std::cout << "\t# of edge:\t" << this->edge_size << std::endl;
+    std::cout << "\t# of node:\t" << this->index2node.size() << std::endl;
+}
+
+void FileGraph::add_edge(long from_index, long to_index, double weight, int undirected) {
+    this->index_graph[from_index][to_index] = weight;
+    if (undirected)
+    {
+        this->index_graph[to_index][from_index] = weight;
+    }
+}
+
+void FileGraph::check_index(long index, size_t names) {
+    if (index < 0 || index >= (long)names)
+        throw std::out_of_range("node " + std::to_string(index) + " is not in the node map of " + std::to_string(names) + " names");
+}
+
 void FileGraph::load_file_status(std::string path) {
     /* Get file names and lines.
      */
@@ -16,10 +60,7 @@ void FileGraph::load_file_status(std::string path) {
     // get file names
     int _is_directory = is_directory(path);
     if (_is_directory==-1) // fail
-    {
-        std::cout << "cannot access " << path << std::endl;
-        exit(0);
-    }
+        throw std::runtime_error("cannot access " + path);
     else if (_is_directory==1) // folder with multiple files
     {
         DIR *dir;
@@ -117,8 +158,10 @@ void FileGraph::load_from_edge_list(std::string path, int undirected) {
 std::vector<long> FileGraph::get_all_nodes() {
     std::unordered_map<long, int> keys;
     std::vector<long> nodes;
+    // samplers leave empty entries for the nodes without edges here
     for (auto kv : this->index_graph) {
-        keys[kv.first] = 1;
+        if (kv.second.size())
+            keys[kv.first] = 1;
         for (auto v: kv.second)
             keys[v.first] = 1;
     }
@@ -146,6 +189,44 @@ std::vector<long> FileGraph::get_all_to_nodes() {
     return nodes;
 }
 
+std::vector<double> FileGraph::get_degrees() {
+    std::vector<double> degrees(this->index2node.size(), 0.0);
+    for (auto& kv: this->index_graph)
+        for (auto& v: kv.second)
+        {
+            degrees[kv.first] += v.second;
+            degrees[v.first] += v.second;
+        }
+    return degrees;
+}
+
+CSRGraph FileGraph::build_csr() {
+    CSRGraph csr;
+    csr.num_rows = this->index2node.size();
+    csr.offsets.assign(csr.num_rows+1, 0);
+    for (auto& kv: this->index_graph)
+        csr.offsets[kv.first+1] = kv.second.size();
+    for (long row=0; row<csr.num_rows; row++)
+        csr.offsets[row+1] += csr.offsets[row];
+    csr.columns.resize(csr.offsets[csr.num_rows]);
+    csr.weights.resize(csr.offsets[csr.num_rows]);
+
+    std::vector<std::pair<long, double>> neighbors;
+    for (auto& kv: this->index_graph)
+    {
+        neighbors.assign(kv.second.begin(), kv.second.end());
+        std::sort(neighbors.begin(), neighbors.end());
+        long offset = csr.offsets[kv.first];
+        for (auto it: neighbors)
+        {
+            csr.columns[offset] = it.first;
+            csr.weights[offset] = it.second;
+            offset++;
+        }
+    }
+    return csr;
+}
+
 void FileGraph::inherit_index2node(std::vector<char*>& index2node) {
     std::cout << "\tinheriting the node map" << std::endl;
     for (int index=0; index<index2node.size(); index++)
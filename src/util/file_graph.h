@@ -1,9 +1,11 @@
 #ifndef BASE_SAMPLER_H
 #define BASE_SAMPLER_H
+#include <algorithm>
 #include <string>
 #include <string.h>
 #include <unordered_map>
 #include <set>
+#include <stdexcept>
 #include <vector>
 #include <dirent.h>
 #include <sys/types.h>
@@ -16,6 +18,39 @@
 
 typedef std::unordered_map<long, std::unordered_map<long, double>> IndexGraph;
 
+struct CSRGraph {
+    /* CSRGraph is a read-only compressed sparse row copy of an IndexGraph:
+     * the neighbors of row i are columns[offsets[i]..offsets[i+1]), sorted,
+     * with their weights alongside.
+     */
+    long num_rows;
+    std::vector<long> offsets;
+    std::vector<long> columns;
+    std::vector<double> weights;
+};
+
+struct EdgeArrays {
+    /* EdgeArrays points at caller-owned edges: edge e runs from node from[e]
+     * to node to[e] with weights[e], or 1 when weights is NULL. Nodes are
+     * indexes into the name dictionary the graph is built with.
+     */
+    long edge_size;
+    const long* from;
+    const long* to;
+    const double* weights;
+};
+
+struct CSRArrays {
+    /* CSRArrays points at a caller-owned CSR: the edges of node i go to
+     * columns[offsets[i]..offsets[i+1]), with weights alongside (or 1 when
+     * weights is NULL), laid out like CSRGraph.
+     */
+    long num_rows;
+    const long* offsets;
+    const long* columns;
+    const double* weights;
+};
+
 class FileGraph {
     /* FileGraph loads file-based data as a graph.
      */
@@ -29,6 +64,11 @@ class FileGraph {
         // load from files
         void load_from_edge_list(std::string path, int undirected);
 
+        // load from memory, on top of an inherited node map; the indexes are
+        // checked against it before anything is loaded
+        void add_edge(long from_index, long to_index, double weight, int undirected);
+        static void check_index(long index, size_t names);
+
         // TODO: implement other ways to read from grpah files
         //void load_from_adjacency_list(std::string path);
 
@@ -36,11 +76,18 @@ class FileGraph {
         // constuctor
         FileGraph(std::string path, int undirected);
         FileGraph(std::string path, int undirected, std::vector<char*>& index2node);
+        // in-memory graphs over the nodes named by index2node, nothing parsed;
+        // throw std::out_of_range on an edge with a node that has no name
+        FileGraph(const EdgeArrays& edges, int undirected, std::vector<char*>& index2node);
+        FileGraph(const CSRArrays& csr, int undirected, std::vector<char*>& index2node);
 
         // func
         std::vector<long> get_all_nodes();
         std::vector<long> get_all_from_nodes();
         std::vector<long> get_all_to_nodes();
+        // total weight of the edges at every node, either end
+        std::vector<double> get_degrees();
+        CSRGraph build_csr();
 
         // graph-related variables
         long edge_size=0;
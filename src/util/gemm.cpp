@@ -0,0 +1,115 @@
+#include "gemm.h"
+
+template<typename Real>
+VECTOR_KERNEL_CLONES
+void gemm_nt(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc) {
+    for (int kb=0; kb<k; kb+=GEMM_BLOCK_K)
+    {
+        int kl = k-kb < GEMM_BLOCK_K ? k-kb : GEMM_BLOCK_K;
+        for (int jb=0; jb<n; jb+=GEMM_BLOCK_N)
+        {
+            int je = jb+GEMM_BLOCK_N < n ? jb+GEMM_BLOCK_N : n;
+            int i = 0;
+            // 4 x 4 tiles: every loaded element of a and b feeds 4 products
+            for (; i+4<=m; i+=4)
+            {
+                const Real* a0 = a + (long)i*lda + kb;
+                const Real* a1 = a0 + lda;
+                const Real* a2 = a1 + lda;
+                const Real* a3 = a2 + lda;
+                int j = jb;
+                for (; j+4<=je; j+=4)
+                {
+                    const Real* b0 = b + (long)j*ldb + kb;
+                    const Real* b1 = b0 + ldb;
+                    const Real* b2 = b1 + ldb;
+                    const Real* b3 = b2 + ldb;
+                    Real s[4][4] = {{0}};
+                    for (int p=0; p<kl; p++)
+                    {
+                        s[0][0] += a0[p]*b0[p]; s[0][1] += a0[p]*b1[p]; s[0][2] += a0[p]*b2[p]; s[0][3] += a0[p]*b3[p];
+                        s[1][0] += a1[p]*b0[p]; s[1][1] += a1[p]*b1[p]; s[1][2] += a1[p]*b2[p]; s[1][3] += a1[p]*b3[p];
+                        s[2][0] += a2[p]*b0[p]; s[2][1] += a2[p]*b1[p]; s[2][2] += a2[p]*b2[p]; s[2][3] += a2[p]*b3[p];
+                        s[3][0] += a3[p]*b0[p]; s[3][1] += a3[p]*b1[p]; s[3][2] += a3[p]*b2[p]; s[3][3] += a3[p]*b3[p];
+                    }
+                    for (int r=0; r<4; r++)
+                        for (int q=0; q<4; q++)
+                            c[(long)(i+r)*ldc + j+q] += alpha*s[r][q];
+                }
+                for (; j<je; j++)
+                {
+                    const Real* b0 = b + (long)j*ldb + kb;
+                    Real s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                    for (int p=0; p<kl; p++)
+                    {
+                        s0 += a0[p]*b0[p]; s1 += a1[p]*b0[p]; s2 += a2[p]*b0[p]; s3 += a3[p]*b0[p];
+                    }
+                    c[(long)i*ldc + j] += alpha*s0;
+                    c[(long)(i+1)*ldc + j] += alpha*s1;
+                    c[(long)(i+2)*ldc + j] += alpha*s2;
+                    c[(long)(i+3)*ldc + j] += alpha*s3;
+                }
+            }
+            for (; i<m; i++)
+            {
+                const Real* a0 = a + (long)i*lda + kb;
+                for (int j=jb; j<je; j++)
+                {
+                    const Real* b0 = b + (long)j*ldb + kb;
+                    Real s0 = 0;
+                    for (int p=0; p<kl; p++)
+                        s0 += a0[p]*b0[p];
+                    c[(long)i*ldc + j] += alpha*s0;
+                }
+            }
+        }
+    }
+}
+
+template<typename Real>
+VECTOR_KERNEL_CLONES
+void gemm_nn(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc) {
+    // rows of c are updated by contiguous axpys over a block of b's columns
+    for (int jb=0; jb<n; jb+=GEMM_BLOCK_K)
+    {
+        int jl = n-jb < GEMM_BLOCK_K ? n-jb : GEMM_BLOCK_K;
+        for (int i=0; i<m; i++)
+        {
+            Real* c0 = c + (long)i*ldc + jb;
+            for (int p=0; p<k; p++)
+            {
+                Real scale = alpha*a[(long)i*lda + p];
+                const Real* b0 = b + (long)p*ldb + jb;
+                for (int j=0; j<jl; j++)
+                    c0[j] += scale*b0[j];
+            }
+        }
+    }
+}
+
+template<typename Real>
+VECTOR_KERNEL_CLONES
+void gemm_tn(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc) {
+    for (int jb=0; jb<n; jb+=GEMM_BLOCK_K)
+    {
+        int jl = n-jb < GEMM_BLOCK_K ? n-jb : GEMM_BLOCK_K;
+        for (int i=0; i<m; i++)
+        {
+            Real* c0 = c + (long)i*ldc + jb;
+            for (int p=0; p<k; p++)
+            {
+                Real scale = alpha*a[(long)p*lda + i];
+                const Real* b0 = b + (long)p*ldb + jb;
+                for (int j=0; j<jl; j++)
+                    c0[j] += scale*b0[j];
+            }
+        }
+    }
+}
+
+template void gemm_nt<double>(int, int, int, double, const double*, int, const double*, int, double*, int);
+template void gemm_nt<float>(int, int, int, float, const float*, int, const float*, int, float*, int);
+template void gemm_nn<double>(int, int, int, double, const double*, int, const double*, int, double*, int);
+template void gemm_nn<float>(int, int, int, float, const float*, int, const float*, int, float*, int);
+template void gemm_tn<double>(int, int, int, double, const double*, int, const double*, int, double*, int);
+template void gemm_tn<float>(int, int, int, float, const float*, int, const float*, int, float*, int);
@@ -0,0 +1,22 @@
+#ifndef GEMM_H
+#define GEMM_H
+#include "vector_kernels.h"
+
+// row-major, cache-blocked matrix products for mini-batch training; all of
+// them accumulate into c, so clear it first for a plain product.
+// Blocks of GEMM_BLOCK_K columns of the shared dimension and GEMM_BLOCK_N
+// rows/columns of the right-hand side are reused while they are in L1.
+#define GEMM_BLOCK_N 64
+#define GEMM_BLOCK_K 256
+
+// c[m x n] += alpha * a[m x k] * b[n x k]^T (row dot products, e.g. scores)
+template<typename Real>
+void gemm_nt(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc);
+// c[m x n] += alpha * a[m x k] * b[k x n]
+template<typename Real>
+void gemm_nn(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc);
+// c[m x n] += alpha * a[k x m]^T * b[k x n]
+template<typename Real>
+void gemm_tn(int m, int n, int k, Real alpha, const Real* a, int lda, const Real* b, int ldb, Real* c, int ldc);
+
+#endif
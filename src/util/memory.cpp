@@ -0,0 +1,90 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "memory.h"
+
+size_t align_size(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+void* allocate_aligned(size_t bytes, int huge_page) {
+    void* buffer = NULL;
+    if (huge_page)
+    {
+        // try reserved huge pages first, then fall back to transparent huge pages
+        size_t mapped_bytes = align_size(bytes, HUGE_PAGE_SIZE);
+        buffer = mmap(NULL, mapped_bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (buffer == MAP_FAILED)
+        {
+            buffer = mmap(NULL, mapped_bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (buffer == MAP_FAILED)
+            {
+                std::cout << "fail to allocate " << bytes << " bytes" << std::endl;
+                exit(1);
+            }
+            madvise(buffer, mapped_bytes, MADV_HUGEPAGE);
+        }
+        return buffer;
+    }
+
+    if (posix_memalign(&buffer, CACHE_LINE_SIZE, align_size(bytes, CACHE_LINE_SIZE)) != 0)
+    {
+        std::cout << "fail to allocate " << bytes << " bytes" << std::endl;
+        exit(1);
+    }
+    return buffer;
+}
+
+void release_aligned(void* buffer, size_t bytes, int huge_page) {
+    if (buffer == NULL)
+        return;
+    if (huge_page)
+        munmap(buffer, align_size(bytes, HUGE_PAGE_SIZE));
+    else
+        free(buffer);
+}
+
+int parse_advice(std::string name) {
+    if (name == "normal")
+        return ADVICE_NORMAL;
+    if (name == "random")
+        return ADVICE_RANDOM;
+    if (name == "sequential")
+        return ADVICE_SEQUENTIAL;
+    if (name == "willneed")
+        return ADVICE_WILLNEED;
+    return -1;
+}
+
+void* map_file(std::string path, size_t bytes, int advice) {
+    int fd = open(path.c_str(), O_RDWR|O_CREAT, 0644);
+    if (fd == -1 || ftruncate(fd, bytes) != 0)
+    {
+        std::cout << "fail to create " << bytes << " bytes at " << path << std::endl;
+        exit(1);
+    }
+    void* buffer = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED)
+    {
+        std::cout << "fail to map " << bytes << " bytes at " << path << std::endl;
+        exit(1);
+    }
+    if (advice == ADVICE_RANDOM)
+        madvise(buffer, bytes, MADV_RANDOM);
+    else if (advice == ADVICE_SEQUENTIAL)
+        madvise(buffer, bytes, MADV_SEQUENTIAL);
+    else if (advice == ADVICE_WILLNEED)
+        madvise(buffer, bytes, MADV_WILLNEED);
+    return buffer;
+}
+
+void sync_file(void* buffer, size_t bytes, int wait) {
+    if (msync(buffer, bytes, wait ? MS_SYNC : MS_ASYNC) != 0)
+        std::cout << "fail to sync " << bytes << " mapped bytes" << std::endl;
+}
+
+void unmap_file(void* buffer, size_t bytes) {
+    if (buffer != NULL)
+        munmap(buffer, bytes);
+}
@@ -0,0 +1,40 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE (2UL*1024*1024)
+
+// round bytes up to a multiple of alignment
+size_t align_size(size_t bytes, size_t alignment);
+
+// cache-line aligned buffer, optionally backed by huge pages
+void* allocate_aligned(size_t bytes, int huge_page);
+void release_aligned(void* buffer, size_t bytes, int huge_page);
+
+// hint every cache line of [buffer, buffer+bytes) into the cache; unlike a
+// load, a prefetch never faults and never stalls the instructions after it
+inline void prefetch_lines(const void* buffer, size_t bytes) {
+    const char* line = (const char*)buffer;
+    for (size_t offset=0; offset<bytes; offset+=CACHE_LINE_SIZE)
+        __builtin_prefetch(line + offset, 0, 3);
+}
+
+// access hints for file-backed buffers
+#define ADVICE_NORMAL 0
+#define ADVICE_RANDOM 1
+#define ADVICE_SEQUENTIAL 2
+#define ADVICE_WILLNEED 3
+// "normal" / "random" / "sequential" / "willneed" -> ADVICE_*, -1 if unknown
+int parse_advice(std::string name);
+
+// shared, writable mapping of the first `bytes` of a file, which is created
+// or resized to exactly that size; pages live in the page cache and the file
+void* map_file(std::string path, size_t bytes, int advice);
+// write dirty pages back, blocking until they are on disk if wait
+void sync_file(void* buffer, size_t bytes, int wait);
+void unmap_file(void* buffer, size_t bytes);
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+#include <sstream>
+#include "numa_topology.h"
+
+#define NUMA_MAX_NODES 1024
+
+int parse_placement(std::string name) {
+    if (name == "first_touch")
+        return PLACEMENT_FIRST_TOUCH;
+    if (name == "interleave")
+        return PLACEMENT_INTERLEAVE;
+    if (name == "partition")
+        return PLACEMENT_PARTITION;
+    return -1;
+}
+
+// "0-3,8,10-11" -> 0 1 2 3 8 10 11; empty when the file is missing
+static std::vector<int> read_list(std::string path) {
+    std::vector<int> values;
+    std::ifstream file(path.c_str());
+    std::string line, range;
+    if (!std::getline(file, line))
+        return values;
+    std::stringstream ranges(line);
+    while (std::getline(ranges, range, ','))
+    {
+        int first, last;
+        if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2)
+            for (int value=first; value<=last; value++)
+                values.push_back(value);
+        else if (sscanf(range.c_str(), "%d", &first) == 1)
+            values.push_back(first);
+    }
+    return values;
+}
+
+NumaTopology::NumaTopology(int simulated_nodes) : simulated(simulated_nodes > 0) {
+    std::vector<int> online = read_list("/sys/devices/system/cpu/online");
+    if (online.empty())
+        for (long cpu=0; cpu<sysconf(_SC_NPROCESSORS_ONLN); cpu++)
+            online.push_back(cpu);
+
+    std::vector<int> node_ids = read_list("/sys/devices/system/node/online");
+    for (size_t n=0; n<node_ids.size(); n++)
+    {
+        std::stringstream path;
+        path << "/sys/devices/system/node/node" << node_ids[n] << "/cpulist";
+        std::vector<int> node_cpus = read_list(path.str());
+        // memory-only nodes have no CPUs to pin to
+        if (!node_cpus.empty() && node_ids[n] < NUMA_MAX_NODES)
+        {
+            this->cpus.push_back(node_cpus);
+            this->node_ids.push_back(node_ids[n]);
+        }
+    }
+    if (this->cpus.empty())
+    {
+        this->cpus.push_back(online);
+        this->node_ids.push_back(0);
+    }
+    this->real_nodes = (int)this->cpus.size();
+
+    if (this->simulated)
+    {
+        this->cpus.assign(simulated_nodes, std::vector<int>());
+        for (size_t c=0; c<online.size(); c++)
+            this->cpus[c % simulated_nodes].push_back(online[c]);
+        for (int node=0; node<simulated_nodes; node++)
+            if (this->cpus[node].empty())
+                this->cpus[node].push_back(online[node % online.size()]);
+    }
+}
+
+int NumaTopology::node_of_worker(int worker, int num_workers) {
+    return (int)((long)worker*this->nodes()/num_workers);
+}
+
+int NumaTopology::pin_thread(int node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t c=0; c<this->cpus[node].size(); c++)
+        CPU_SET(this->cpus[node][c], &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+// mbind(2) over the whole pages of [begin, end) with one of the memory nodes
+static int bind_pages(char* begin, char* end, int mode, const std::vector<int>& memory_nodes) {
+    unsigned long mask[NUMA_MAX_NODES/(8*sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    for (size_t n=0; n<memory_nodes.size(); n++)
+        mask[memory_nodes[n]/(8*sizeof(unsigned long))] |= 1UL << (memory_nodes[n]%(8*sizeof(unsigned long)));
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)begin/page*page, last = ((uintptr_t)end + page - 1)/page*page;
+    if (last <= first)
+        return 0;
+    return syscall(SYS_mbind, first, last - first, mode, mask, NUMA_MAX_NODES, MPOL_MF_MOVE);
+}
+
+int NumaTopology::place(void* buffer, size_t bytes, int placement) {
+    char* begin = (char*)buffer;
+    if (placement == PLACEMENT_INTERLEAVE)
+    {
+        std::vector<int> memory_nodes;
+        for (int node=0; node<this->nodes(); node++)
+            memory_nodes.push_back(this->memory_node(node));
+        return bind_pages(begin, begin + bytes, MPOL_INTERLEAVE, memory_nodes);
+    }
+    if (placement == PLACEMENT_PARTITION)
+    {
+        for (int node=0; node<this->nodes(); node++)
+        {
+            // a page on a part's border goes to the later part
+            std::vector<int> memory_nodes(1, this->memory_node(node));
+            if (bind_pages(begin + bytes*node/this->nodes(), begin + bytes*(node+1)/this->nodes(), MPOL_BIND, memory_nodes) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+std::string NumaTopology::describe() {
+    std::stringstream text;
+    text << this->nodes() << (this->simulated ? " simulated" : "") << " nodes (";
+    for (int node=0; node<this->nodes(); node++)
+        text << (node ? ", " : "") << this->cpus[node].size() << " CPUs";
+    text << ")";
+    if (this->simulated)
+        text << " over " << this->real_nodes << " real";
+    return text.str();
+}
@@ -0,0 +1,51 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// placement of a shared buffer over the nodes
+#define PLACEMENT_FIRST_TOUCH 0
+#define PLACEMENT_INTERLEAVE 1
+#define PLACEMENT_PARTITION 2
+// "first_touch" / "interleave" / "partition" -> PLACEMENT_*, -1 if unknown
+int parse_placement(std::string name);
+
+class NumaTopology {
+    /* NumaTopology lists the CPUs of every NUMA node that has some, as sysfs
+     * reports them; node k is the k-th of those, and `node_ids` keeps its
+     * sysfs id, which memory policies need (ids can have gaps, and
+     * memory-only nodes are skipped).
+     * With `simulated` nodes the online CPUs are dealt round robin over that
+     * many nodes instead (a box with fewer CPUs than nodes reuses them) and
+     * the memory of node k goes to the real node k % real_nodes, so that
+     * pinning and placement run unchanged on a single-node box.
+     * Memory policies go straight to mbind(2); there is no libnuma dependency.
+     */
+    public:
+        std::vector<std::vector<int> > cpus;
+        std::vector<int> node_ids;
+        int real_nodes;
+        int simulated;
+
+        // constructor; simulated_nodes = 0 reads the machine's topology
+        NumaTopology(int simulated_nodes);
+
+        int nodes() { return (int)this->cpus.size(); }
+        // workers are spread over the nodes in contiguous blocks
+        int node_of_worker(int worker, int num_workers);
+        // restrict the calling thread to the CPUs of node; 0 on success
+        int pin_thread(int node);
+        // first_touch leaves the pages alone; interleave deals the pages of
+        // [buffer, buffer+bytes) round robin over the nodes, and partition
+        // binds the k-th of nodes() contiguous parts to node k. Pages already
+        // touched are moved. 0 on success
+        int place(void* buffer, size_t bytes, int placement);
+        std::string describe();
+
+    private:
+        // the sysfs id of the real node holding node's memory
+        int memory_node(int node) { return this->node_ids[node % this->real_nodes]; }
+};
+
+#endif
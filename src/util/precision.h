@@ -0,0 +1,99 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+#include <string.h>
+#include <string>
+
+#define PRECISION_DOUBLE 0
+#define PRECISION_FLOAT 1
+#define PRECISION_BFLOAT16 2
+
+struct bfloat16 {
+    /* bfloat16 keeps the upper 16 bits of a float32 (8-bit exponent, 7-bit
+     * mantissa). It is a storage-only type: all the math runs in float32.
+     */
+    unsigned short bits;
+};
+
+inline float bfloat16_to_float(bfloat16 value) {
+    unsigned int bits = (unsigned int)value.bits << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+inline bfloat16 float_to_bfloat16(float value) {
+    // round to nearest even; NaN stays a quiet NaN
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(float));
+    bfloat16 result;
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        result.bits = (bits >> 16) | 0x0040;
+    else
+        result.bits = (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+    return result;
+}
+
+inline bfloat16 float_to_bfloat16_stochastic(float value) {
+    // stochastic rounding keeps small SGD steps from being rounded away:
+    // the truncated bits are compared against per-thread xorshift noise
+    static thread_local unsigned int noise = 2463534242u;
+    noise ^= noise << 13;
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(float));
+    bfloat16 result;
+    if ((bits & 0x7f800000) == 0x7f800000)
+        return float_to_bfloat16(value);
+    result.bits = (bits + (noise & 0xffff)) >> 16;
+    return result;
+}
+
+/* StorageTraits maps a storage type onto the type the math runs in and
+ * converts between the two.
+ */
+template<typename T>
+struct StorageTraits;
+
+template<>
+struct StorageTraits<double> {
+    typedef double real;
+    static double load(double value) { return value; }
+    static double store(double value) { return value; }
+    static double store_stochastic(double value) { return value; }
+    static int precision() { return PRECISION_DOUBLE; }
+    static const char* name() { return "double"; }
+};
+
+template<>
+struct StorageTraits<float> {
+    typedef float real;
+    static float load(float value) { return value; }
+    static float store(float value) { return value; }
+    static float store_stochastic(float value) { return value; }
+    static int precision() { return PRECISION_FLOAT; }
+    static const char* name() { return "float"; }
+};
+
+template<>
+struct StorageTraits<bfloat16> {
+    typedef float real;
+    static float load(bfloat16 value) { return bfloat16_to_float(value); }
+    static bfloat16 store(float value) { return float_to_bfloat16(value); }
+    static bfloat16 store_stochastic(float value) { return float_to_bfloat16_stochastic(value); }
+    static int precision() { return PRECISION_BFLOAT16; }
+    static const char* name() { return "bf16"; }
+};
+
+// "double" / "float" / "bf16" -> PRECISION_*, -1 if unknown
+inline int parse_precision(std::string name) {
+    if (name == "double")
+        return PRECISION_DOUBLE;
+    if (name == "float")
+        return PRECISION_FLOAT;
+    if (name == "bf16")
+        return PRECISION_BFLOAT16;
+    return -1;
+}
+
+#endif
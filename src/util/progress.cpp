@@ -0,0 +1,69 @@
+#include <math.h>
+#include <omp.h>
+#include "progress.h"
+
+int parse_schedule(std::string name) {
+    if (name == "linear")
+        return SCHEDULE_LINEAR;
+    if (name == "cosine")
+        return SCHEDULE_COSINE;
+    if (name == "warmup")
+        return SCHEDULE_WARMUP;
+    return -1;
+}
+
+double scheduled_alpha(int schedule, double init_alpha, double progress, double warmup) {
+    double ratio;
+    if (schedule == SCHEDULE_COSINE)
+        ratio = 0.5*(1.0 + cos(M_PI*progress));
+    else if (schedule == SCHEDULE_WARMUP && progress < warmup)
+        ratio = progress/warmup;
+    else if (schedule == SCHEDULE_WARMUP)
+        ratio = 1.0 - (progress - warmup)/(1.0 - warmup);
+    else
+        ratio = 1.0 - progress;
+    if (ratio < SCHEDULE_MIN_RATIO)
+        ratio = SCHEDULE_MIN_RATIO;
+    return init_alpha*ratio;
+}
+
+ProgressCounters::ProgressCounters(int num_workers, unsigned long long base) : workers(num_workers) {
+    this->base = base;
+    for (int w=0; w<num_workers; w++)
+        this->set(w, 0);
+    this->window_updates.assign(num_workers, 0);
+    this->window_seconds.resize(num_workers);
+    for (int w=0; w<num_workers; w++)
+        this->window_seconds[w] = this->workers[w].seconds.load(std::memory_order_relaxed);
+    this->last_rates.assign(num_workers, 0.0);
+}
+
+void ProgressCounters::set(int worker, unsigned long long updates) {
+    // the reader loads the time first, so the count it sees is never older
+    this->workers[worker].updates.store(updates, std::memory_order_relaxed);
+    this->workers[worker].seconds.store(omp_get_wtime(), std::memory_order_release);
+}
+
+unsigned long long ProgressCounters::total() {
+    unsigned long long total = this->base;
+    for (size_t w=0; w<this->workers.size(); w++)
+        total += this->get(w);
+    return total;
+}
+
+void ProgressCounters::window_rates(std::vector<double>& rates) {
+    rates.resize(this->workers.size());
+    for (size_t w=0; w<this->workers.size(); w++)
+    {
+        double seconds = this->workers[w].seconds.load(std::memory_order_acquire);
+        unsigned long long updates = this->get(w);
+        // a worker that has not published since the last call keeps its rate
+        if (seconds > this->window_seconds[w])
+        {
+            this->last_rates[w] = (updates - this->window_updates[w])/(seconds - this->window_seconds[w]);
+            this->window_updates[w] = updates;
+            this->window_seconds[w] = seconds;
+        }
+        rates[w] = this->last_rates[w];
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+#include <atomic>
+#include <string>
+#include <vector>
+
+// learning-rate schedules over the whole run, never below SCHEDULE_MIN_RATIO*init_alpha
+#define SCHEDULE_LINEAR 0
+#define SCHEDULE_COSINE 1
+#define SCHEDULE_WARMUP 2
+#define SCHEDULE_MIN_RATIO 0.0001
+
+// "linear" / "cosine" / "warmup" -> SCHEDULE_*, -1 if unknown
+int parse_schedule(std::string name);
+// the learning rate after `progress` (0..1) of the run; warmup is the fraction
+// SCHEDULE_WARMUP ramps up over before it decays linearly
+double scheduled_alpha(int schedule, double init_alpha, double progress, double warmup);
+
+// a worker publishes its count at least every PROGRESS_PUBLISH updates
+#define PROGRESS_PUBLISH 256
+
+struct WorkerProgress {
+    // written by its worker only, so relaxed stores and loads are enough;
+    // `seconds` is when the worker published `updates`
+    std::atomic<unsigned long long> updates;
+    std::atomic<double> seconds;
+    char padding[128 - sizeof(std::atomic<unsigned long long>) - sizeof(std::atomic<double>)];
+};
+
+class ProgressCounters {
+    /* ProgressCounters keep every worker's finished updates in the worker's
+     * own cache lines. A worker publishes its count with set(), every
+     * PROGRESS_PUBLISH updates; the global step is the sum of the published
+     * counts, so nothing is lost to racing increments and the workers never
+     * write a shared line. Every count carries the time it was published,
+     * and window_rates() divides each worker's updates since the last call
+     * by the time between its own publications, so the rates do not depend
+     * on when the reporting thread happens to look.
+     */
+    public:
+        unsigned long long base;
+        std::vector<WorkerProgress> workers;
+
+        // constructor; base = updates finished before this run (resume)
+        ProgressCounters(int num_workers, unsigned long long base);
+
+        void set(int worker, unsigned long long updates);
+        unsigned long long get(int worker) { return this->workers[worker].updates.load(std::memory_order_relaxed); }
+        unsigned long long total();
+        void window_rates(std::vector<double>& rates);
+
+    private:
+        std::vector<unsigned long long> window_updates;
+        std::vector<double> window_seconds, last_rates;
+};
+
+#endif
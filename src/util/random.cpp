@@ -52,3 +52,12 @@ double ran_gaussian(double mean, double stdev) {
     }
 }
 
+double seeded_uniform(unsigned long long* state) {
+    // splitmix64: every state gives an independent draw, so disjoint ranges of
+    // states can be consumed by different threads deterministically
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1.0/9007199254740992.0);
+}
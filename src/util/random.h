@@ -7,5 +7,6 @@ double random_prob();
 double ran_uniform();
 double ran_gaussian();
 double ran_gaussian(double mean, double stdev);
+double seeded_uniform(unsigned long long* state);
 
 #endif
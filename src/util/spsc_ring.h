@@ -0,0 +1,61 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include "memory.h"
+
+template<typename Item>
+class SPSCRing {
+    /* SPSCRing is a lock-free ring of reusable items between exactly one
+     * producer thread and one consumer thread. The producer fills the slot
+     * returned by produce_slot() in place and publishes it with produce();
+     * the consumer reads consume_slot() and hands it back with consume().
+     * Items are never copied, so items that own buffers (e.g. vectors) keep
+     * them across laps. The two positions live on their own cache lines.
+     */
+    public:
+        std::vector<Item> items;
+        size_t mask;
+
+        // capacity is rounded up to a power of two
+        SPSCRing(size_t capacity, const Item& prototype) : head(0), tail(0) {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            this->items.assign(size, prototype);
+            this->mask = size - 1;
+        }
+        SPSCRing(const SPSCRing&) = delete;
+        SPSCRing& operator=(const SPSCRing&) = delete;
+
+        // producer: the next free slot, NULL while the ring is full
+        Item* produce_slot() {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+            if (tail - this->head.load(std::memory_order_acquire) > this->mask)
+                return NULL;
+            return &this->items[tail & this->mask];
+        }
+        void produce() {
+            this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // consumer: the oldest filled slot, NULL while the ring is empty
+        Item* consume_slot() {
+            size_t head = this->head.load(std::memory_order_relaxed);
+            if (head == this->tail.load(std::memory_order_acquire))
+                return NULL;
+            return &this->items[head & this->mask];
+        }
+        void consume() {
+            this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+    private:
+        char head_padding[CACHE_LINE_SIZE];
+        std::atomic<size_t> head;
+        char tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;
+        char end_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+#endif
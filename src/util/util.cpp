@@ -56,12 +56,110 @@ int is_directory(std::string path) {
 }
 
 double dot_similarity(std::vector<double>& embeddingA, std::vector<double>& embeddingB, int dimension) {
-    double prediction=0;
-    for (int d=0; d<dimension; d++)
+    return vk_dot(embeddingA.data(), embeddingB.data(), dimension);
+}
+
+static double power_of_ten(int exponent) {
+    // exact for |exponent| <= 22, which covers the usual embedding values
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (exponent >= 0 && exponent <= 22)
+        return powers[exponent];
+    return pow(10.0, exponent);
+}
+
+int format_shortest(float value, char* buffer) {
+    /* The fewest significant digits whose decimal reads back as `value`,
+     * printed like %g. Candidates are rounded (half to even, as printf does)
+     * in double, which carries 29 more bits than float, and the chosen one is
+     * checked once with strtof; the rare value that fails, zero, inf and nan
+     * go through snprintf. Bits are tested directly since -Ofast assumes
+     * finite math.
+     */
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(float));
+    if ((bits & 0x7fffffff) == 0 || (bits & 0x7f800000) == 0x7f800000)
+        return snprintf(buffer, 32, "%g", value);
+    double exact = fabs((double)value);
+    int exponent = (int)floor(log10(exact));
+    long long mantissa = 0;
+    int digits;
+    for (digits=1; digits<=9; digits++)
+    {
+        int shift = digits-1-exponent;
+        double scaled = shift >= 0 ? exact*power_of_ten(shift) : exact/power_of_ten(-shift);
+        mantissa = llrint(scaled);
+        double candidate = shift >= 0 ? mantissa/power_of_ten(shift) : mantissa*power_of_ten(-shift);
+        if ((float)candidate == (float)exact)
+            break;
+    }
+    if (digits > 9)
+        return snprintf(buffer, 32, "%.9g", value);
+    if (mantissa >= (long long)power_of_ten(digits))
+    {
+        // rounding carried into a new leading digit, e.g. 9.99 -> 10.0
+        mantissa /= 10;
+        exponent++;
+    }
+
+    char text[16];
+    int length = snprintf(text, sizeof(text), "%lld", mantissa);
+    while (length > 1 && text[length-1] == '0')
+        length--;
+    char* out = buffer;
+    if (value < 0)
+        *out++ = '-';
+    if (exponent < -4 || exponent >= digits)
+    {
+        *out++ = text[0];
+        if (length > 1)
+        {
+            *out++ = '.';
+            memcpy(out, text+1, length-1);
+            out += length-1;
+        }
+        out += sprintf(out, "e%c%02d", exponent < 0 ? '-' : '+', exponent < 0 ? -exponent : exponent);
+    }
+    else if (exponent < 0)
     {
-        prediction += embeddingA[d]*embeddingB[d];
+        *out++ = '0';
+        *out++ = '.';
+        for (int z=0; z<-exponent-1; z++)
+            *out++ = '0';
+        memcpy(out, text, length);
+        out += length;
     }
-    return prediction;
+    else
+    {
+        for (int d=0; d<=exponent; d++)
+            *out++ = d < length ? text[d] : '0';
+        if (length > exponent+1)
+        {
+            *out++ = '.';
+            memcpy(out, text+exponent+1, length-exponent-1);
+            out += length-exponent-1;
+        }
+    }
+    *out = '\0';
+    if (strtof(buffer, NULL) != value)
+        return snprintf(buffer, 32, "%.9g", value);
+    return out - buffer;
+}
+
+void TrainingStats::add(const TrainingStats& other) {
+    this->loss += other.loss;
+    this->norm += other.norm;
+    this->pairs += other.pairs;
+    this->active += other.active;
+    this->rows += other.rows;
+}
+
+void TrainingStats::subtract(const TrainingStats& other) {
+    this->loss -= other.loss;
+    this->norm -= other.norm;
+    this->pairs -= other.pairs;
+    this->active -= other.active;
+    this->rows -= other.rows;
 }
 
 Monitor::Monitor(unsigned long long total_step) {
@@ -73,6 +171,24 @@ void Monitor::progress(unsigned long long* current_step) {
     fflush(stdout);
 }
 
+void Monitor::progress(unsigned long long* current_step, TrainingStats& window, std::vector<double>& rates) {
+    double mean_rate = 0.0;
+    int slowest = 0;
+    for (int w=0; w<(int)rates.size(); w++)
+    {
+        mean_rate += rates[w]/rates.size();
+        if (rates[w] < rates[slowest])
+            slowest = w;
+    }
+    printf("\tProgress:\t%.3f %%\tloss %.4f\tactive %.1f %%\tnorm %.4f\t%.1f K/s/worker (slowest #%d %.1f K/s)%c",
+           (double)*current_step/this->total_step*100.0,
+           window.pairs ? window.loss/window.pairs : 0.0,
+           window.pairs ? 100.0*window.active/window.pairs : 0.0,
+           window.rows ? window.norm/window.rows : 0.0,
+           mean_rate/1000.0, slowest, rates.empty() ? 0.0 : rates[slowest]/1000.0, 13);
+    fflush(stdout);
+}
+
 void Monitor::end() {
     printf("\tProgress:\t%.3f\n", 100.0);
 }
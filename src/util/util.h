@@ -1,15 +1,22 @@
 #ifndef UTIL_H
 #define UTIL_H
 #include <sys/stat.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 #include <string>
 #include <string.h>
 #include <vector>
+#include "vector_kernels.h"
 
 int is_directory(std::string path);
 double dot_similarity(std::vector<double>& embeddingA, std::vector<double>& embeddingB, int dimension);
 
+// shortest %g text that reads back to the same float; returns its length,
+// buffer needs 32 bytes
+int format_shortest(float value, char* buffer);
+
 class ArgParser {
     private:
         int argc;
@@ -23,6 +30,35 @@ class ArgParser {
         std::string get_str(std::string flag, std::string value, std::string description);
 };
 
+#define TELEMETRY_ACTIVE_GRADIENT 0.01
+#define TELEMETRY_PERIOD 16
+
+struct TrainingStats {
+    /* TrainingStats are one worker's running sums over its samples: the
+     * loss, how many gradients were still above TELEMETRY_ACTIVE_GRADIENT,
+     * and the L2 norms of the user and item_given rows it wrote, read right
+     * after the write. They only grow, so a window is the difference of two
+     * snapshots, and each worker has its own cache lines so that adding to
+     * them costs a few register operations.
+     */
+    double loss, norm;
+    unsigned long long pairs, active, rows;
+    char padding[128 - 2*sizeof(double) - 3*sizeof(unsigned long long)];
+
+    TrainingStats() : loss(0), norm(0), pairs(0), active(0), rows(0) {}
+    void add_pair(double loss, double gradient) {
+        this->loss += loss;
+        this->pairs++;
+        this->active += gradient > TELEMETRY_ACTIVE_GRADIENT;
+    }
+    void add_row(double norm) {
+        this->norm += norm;
+        this->rows++;
+    }
+    void add(const TrainingStats& other);
+    void subtract(const TrainingStats& other);
+};
+
 class Monitor {
     public:
         unsigned long long total_step;
@@ -32,6 +68,9 @@ class Monitor {
 
         // count
         void progress(unsigned long long* current_step);
+        // with the mean loss, active gradients and row norm of a window, and
+        // the mean and slowest of the workers' updates per second
+        void progress(unsigned long long* current_step, TrainingStats& window, std::vector<double>& rates);
         void end();
 };
 
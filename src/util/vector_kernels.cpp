@@ -0,0 +1,518 @@
+#include "vector_kernels.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_KERNELS_X86
+#endif
+
+// scalar
+template<typename R>
+static R dot_scalar(const R* a, const R* b, int n) {
+    R result = 0;
+    for (int d=0; d<n; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+template<typename R>
+static void axpy_scalar(R alpha, const R* x, R* y, int n) {
+    for (int d=0; d<n; d++)
+        y[d] += alpha*x[d];
+}
+
+template<typename R>
+static void axpy_decay_scalar(R alpha, const R* x, R lambda, R* y, int n) {
+    for (int d=0; d<n; d++)
+        y[d] += alpha*(x[d] - lambda*y[d]);
+}
+
+template<typename R>
+static void sum_rows_scalar(const R* const* rows, int num_rows, R scale, R* out, int n) {
+    for (int d=0; d<n; d++)
+        out[d] = 0;
+    for (int r=0; r<num_rows; r++)
+        for (int d=0; d<n; d++)
+            out[d] += rows[r][d];
+    for (int d=0; d<n; d++)
+        out[d] *= scale;
+}
+
+#ifdef VECTOR_KERNELS_X86
+// sse2
+__attribute__((target("sse2")))
+static double dot_f64_sse2(const double* a, const double* b, int n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    int d = 0;
+    for (; d+4<=n; d+=4)
+    {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+d), _mm_loadu_pd(b+d)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a+d+2), _mm_loadu_pd(b+d+2)));
+    }
+    s0 = _mm_add_pd(s0, s1);
+    double result = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+    for (; d<n; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+__attribute__((target("sse2")))
+static float dot_f32_sse2(const float* a, const float* b, int n) {
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    int d = 0;
+    for (; d+8<=n; d+=8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a+d), _mm_loadu_ps(b+d)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a+d+4), _mm_loadu_ps(b+d+4)));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    float result = _mm_cvtss_f32(s0);
+    for (; d<n; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+__attribute__((target("sse2")))
+static void axpy_f64_sse2(double alpha, const double* x, double* y, int n) {
+    __m128d a = _mm_set1_pd(alpha);
+    int d = 0;
+    for (; d+2<=n; d+=2)
+        _mm_storeu_pd(y+d, _mm_add_pd(_mm_loadu_pd(y+d), _mm_mul_pd(a, _mm_loadu_pd(x+d))));
+    for (; d<n; d++)
+        y[d] += alpha*x[d];
+}
+
+__attribute__((target("sse2")))
+static void axpy_f32_sse2(float alpha, const float* x, float* y, int n) {
+    __m128 a = _mm_set1_ps(alpha);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+        _mm_storeu_ps(y+d, _mm_add_ps(_mm_loadu_ps(y+d), _mm_mul_ps(a, _mm_loadu_ps(x+d))));
+    for (; d<n; d++)
+        y[d] += alpha*x[d];
+}
+
+__attribute__((target("sse2")))
+static void axpy_decay_f64_sse2(double alpha, const double* x, double lambda, double* y, int n) {
+    __m128d a = _mm_set1_pd(alpha), l = _mm_set1_pd(lambda);
+    int d = 0;
+    for (; d+2<=n; d+=2)
+    {
+        __m128d v = _mm_loadu_pd(y+d);
+        __m128d g = _mm_sub_pd(_mm_loadu_pd(x+d), _mm_mul_pd(l, v));
+        _mm_storeu_pd(y+d, _mm_add_pd(v, _mm_mul_pd(a, g)));
+    }
+    for (; d<n; d++)
+        y[d] += alpha*(x[d] - lambda*y[d]);
+}
+
+__attribute__((target("sse2")))
+static void axpy_decay_f32_sse2(float alpha, const float* x, float lambda, float* y, int n) {
+    __m128 a = _mm_set1_ps(alpha), l = _mm_set1_ps(lambda);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+    {
+        __m128 v = _mm_loadu_ps(y+d);
+        __m128 g = _mm_sub_ps(_mm_loadu_ps(x+d), _mm_mul_ps(l, v));
+        _mm_storeu_ps(y+d, _mm_add_ps(v, _mm_mul_ps(a, g)));
+    }
+    for (; d<n; d++)
+        y[d] += alpha*(x[d] - lambda*y[d]);
+}
+
+__attribute__((target("sse2")))
+static void sum_rows_f64_sse2(const double* const* rows, int num_rows, double scale, double* out, int n) {
+    __m128d s = _mm_set1_pd(scale);
+    int d = 0;
+    for (; d+2<=n; d+=2)
+    {
+        __m128d acc = _mm_setzero_pd();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm_add_pd(acc, _mm_loadu_pd(rows[r]+d));
+        _mm_storeu_pd(out+d, _mm_mul_pd(acc, s));
+    }
+    for (; d<n; d++)
+    {
+        double acc = 0;
+        for (int r=0; r<num_rows; r++)
+            acc += rows[r][d];
+        out[d] = acc*scale;
+    }
+}
+
+__attribute__((target("sse2")))
+static void sum_rows_f32_sse2(const float* const* rows, int num_rows, float scale, float* out, int n) {
+    __m128 s = _mm_set1_ps(scale);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm_add_ps(acc, _mm_loadu_ps(rows[r]+d));
+        _mm_storeu_ps(out+d, _mm_mul_ps(acc, s));
+    }
+    for (; d<n; d++)
+    {
+        float acc = 0;
+        for (int r=0; r<num_rows; r++)
+            acc += rows[r][d];
+        out[d] = acc*scale;
+    }
+}
+
+// avx2 + fma
+__attribute__((target("avx2,fma")))
+static double dot_f64_avx2(const double* a, const double* b, int n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    int d = 0;
+    for (; d+8<=n; d+=8)
+    {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+d), _mm256_loadu_pd(b+d), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a+d+4), _mm256_loadu_pd(b+d+4), s1);
+    }
+    for (; d+4<=n; d+=4)
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+d), _mm256_loadu_pd(b+d), s0);
+    s0 = _mm256_add_pd(s0, s1);
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    double result = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; d<n; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_f32_avx2(const float* a, const float* b, int n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int d = 0;
+    for (; d+16<=n; d+=16)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+d), _mm256_loadu_ps(b+d), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+d+8), _mm256_loadu_ps(b+d+8), s1);
+    }
+    for (; d+8<=n; d+=8)
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+d), _mm256_loadu_ps(b+d), s0);
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    float result = _mm_cvtss_f32(h);
+    for (; d<n; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_f64_avx2(double alpha, const double* x, double* y, int n) {
+    __m256d a = _mm256_set1_pd(alpha);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+        _mm256_storeu_pd(y+d, _mm256_fmadd_pd(a, _mm256_loadu_pd(x+d), _mm256_loadu_pd(y+d)));
+    for (; d<n; d++)
+        y[d] += alpha*x[d];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_f32_avx2(float alpha, const float* x, float* y, int n) {
+    __m256 a = _mm256_set1_ps(alpha);
+    int d = 0;
+    for (; d+8<=n; d+=8)
+        _mm256_storeu_ps(y+d, _mm256_fmadd_ps(a, _mm256_loadu_ps(x+d), _mm256_loadu_ps(y+d)));
+    for (; d<n; d++)
+        y[d] += alpha*x[d];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_decay_f64_avx2(double alpha, const double* x, double lambda, double* y, int n) {
+    __m256d a = _mm256_set1_pd(alpha), l = _mm256_set1_pd(-lambda);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+    {
+        __m256d v = _mm256_loadu_pd(y+d);
+        __m256d g = _mm256_fmadd_pd(l, v, _mm256_loadu_pd(x+d));
+        _mm256_storeu_pd(y+d, _mm256_fmadd_pd(a, g, v));
+    }
+    for (; d<n; d++)
+        y[d] += alpha*(x[d] - lambda*y[d]);
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_decay_f32_avx2(float alpha, const float* x, float lambda, float* y, int n) {
+    __m256 a = _mm256_set1_ps(alpha), l = _mm256_set1_ps(-lambda);
+    int d = 0;
+    for (; d+8<=n; d+=8)
+    {
+        __m256 v = _mm256_loadu_ps(y+d);
+        __m256 g = _mm256_fmadd_ps(l, v, _mm256_loadu_ps(x+d));
+        _mm256_storeu_ps(y+d, _mm256_fmadd_ps(a, g, v));
+    }
+    for (; d<n; d++)
+        y[d] += alpha*(x[d] - lambda*y[d]);
+}
+
+__attribute__((target("avx2,fma")))
+static void sum_rows_f64_avx2(const double* const* rows, int num_rows, double scale, double* out, int n) {
+    __m256d s = _mm256_set1_pd(scale);
+    int d = 0;
+    for (; d+4<=n; d+=4)
+    {
+        __m256d acc = _mm256_setzero_pd();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm256_add_pd(acc, _mm256_loadu_pd(rows[r]+d));
+        _mm256_storeu_pd(out+d, _mm256_mul_pd(acc, s));
+    }
+    for (; d<n; d++)
+    {
+        double acc = 0;
+        for (int r=0; r<num_rows; r++)
+            acc += rows[r][d];
+        out[d] = acc*scale;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void sum_rows_f32_avx2(const float* const* rows, int num_rows, float scale, float* out, int n) {
+    __m256 s = _mm256_set1_ps(scale);
+    int d = 0;
+    for (; d+8<=n; d+=8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm256_add_ps(acc, _mm256_loadu_ps(rows[r]+d));
+        _mm256_storeu_ps(out+d, _mm256_mul_ps(acc, s));
+    }
+    for (; d<n; d++)
+    {
+        float acc = 0;
+        for (int r=0; r<num_rows; r++)
+            acc += rows[r][d];
+        out[d] = acc*scale;
+    }
+}
+
+// avx512f, tails handled by masked loads / stores
+__attribute__((target("avx512f")))
+static double dot_f64_avx512(const double* a, const double* b, int n) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    int d = 0;
+    for (; d+16<=n; d+=16)
+    {
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+d), _mm512_loadu_pd(b+d), s0);
+        s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a+d+8), _mm512_loadu_pd(b+d+8), s1);
+    }
+    for (; d+8<=n; d+=8)
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a+d), _mm512_loadu_pd(b+d), s0);
+    if (d < n)
+    {
+        __mmask8 m = (__mmask8)((1u << (n-d)) - 1);
+        s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a+d), _mm512_maskz_loadu_pd(m, b+d), s1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(s0, s1));
+}
+
+__attribute__((target("avx512f")))
+static float dot_f32_avx512(const float* a, const float* b, int n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    int d = 0;
+    for (; d+32<=n; d+=32)
+    {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+d), _mm512_loadu_ps(b+d), s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a+d+16), _mm512_loadu_ps(b+d+16), s1);
+    }
+    for (; d+16<=n; d+=16)
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a+d), _mm512_loadu_ps(b+d), s0);
+    if (d < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n-d)) - 1);
+        s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a+d), _mm512_maskz_loadu_ps(m, b+d), s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f")))
+static void axpy_f64_avx512(double alpha, const double* x, double* y, int n) {
+    __m512d a = _mm512_set1_pd(alpha);
+    int d = 0;
+    for (; d+8<=n; d+=8)
+        _mm512_storeu_pd(y+d, _mm512_fmadd_pd(a, _mm512_loadu_pd(x+d), _mm512_loadu_pd(y+d)));
+    if (d < n)
+    {
+        __mmask8 m = (__mmask8)((1u << (n-d)) - 1);
+        _mm512_mask_storeu_pd(y+d, m, _mm512_fmadd_pd(a, _mm512_maskz_loadu_pd(m, x+d), _mm512_maskz_loadu_pd(m, y+d)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_f32_avx512(float alpha, const float* x, float* y, int n) {
+    __m512 a = _mm512_set1_ps(alpha);
+    int d = 0;
+    for (; d+16<=n; d+=16)
+        _mm512_storeu_ps(y+d, _mm512_fmadd_ps(a, _mm512_loadu_ps(x+d), _mm512_loadu_ps(y+d)));
+    if (d < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n-d)) - 1);
+        _mm512_mask_storeu_ps(y+d, m, _mm512_fmadd_ps(a, _mm512_maskz_loadu_ps(m, x+d), _mm512_maskz_loadu_ps(m, y+d)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_decay_f64_avx512(double alpha, const double* x, double lambda, double* y, int n) {
+    __m512d a = _mm512_set1_pd(alpha), l = _mm512_set1_pd(-lambda);
+    int d = 0;
+    for (; d+8<=n; d+=8)
+    {
+        __m512d v = _mm512_loadu_pd(y+d);
+        __m512d g = _mm512_fmadd_pd(l, v, _mm512_loadu_pd(x+d));
+        _mm512_storeu_pd(y+d, _mm512_fmadd_pd(a, g, v));
+    }
+    if (d < n)
+    {
+        __mmask8 m = (__mmask8)((1u << (n-d)) - 1);
+        __m512d v = _mm512_maskz_loadu_pd(m, y+d);
+        __m512d g = _mm512_fmadd_pd(l, v, _mm512_maskz_loadu_pd(m, x+d));
+        _mm512_mask_storeu_pd(y+d, m, _mm512_fmadd_pd(a, g, v));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_decay_f32_avx512(float alpha, const float* x, float lambda, float* y, int n) {
+    __m512 a = _mm512_set1_ps(alpha), l = _mm512_set1_ps(-lambda);
+    int d = 0;
+    for (; d+16<=n; d+=16)
+    {
+        __m512 v = _mm512_loadu_ps(y+d);
+        __m512 g = _mm512_fmadd_ps(l, v, _mm512_loadu_ps(x+d));
+        _mm512_storeu_ps(y+d, _mm512_fmadd_ps(a, g, v));
+    }
+    if (d < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n-d)) - 1);
+        __m512 v = _mm512_maskz_loadu_ps(m, y+d);
+        __m512 g = _mm512_fmadd_ps(l, v, _mm512_maskz_loadu_ps(m, x+d));
+        _mm512_mask_storeu_ps(y+d, m, _mm512_fmadd_ps(a, g, v));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sum_rows_f64_avx512(const double* const* rows, int num_rows, double scale, double* out, int n) {
+    __m512d s = _mm512_set1_pd(scale);
+    for (int d=0; d<n; d+=8)
+    {
+        __mmask8 m = (n-d >= 8) ? (__mmask8)0xff : (__mmask8)((1u << (n-d)) - 1);
+        __m512d acc = _mm512_setzero_pd();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm512_add_pd(acc, _mm512_maskz_loadu_pd(m, rows[r]+d));
+        _mm512_mask_storeu_pd(out+d, m, _mm512_mul_pd(acc, s));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sum_rows_f32_avx512(const float* const* rows, int num_rows, float scale, float* out, int n) {
+    __m512 s = _mm512_set1_ps(scale);
+    for (int d=0; d<n; d+=16)
+    {
+        __mmask16 m = (n-d >= 16) ? (__mmask16)0xffff : (__mmask16)((1u << (n-d)) - 1);
+        __m512 acc = _mm512_setzero_ps();
+        for (int r=0; r<num_rows; r++)
+            acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(m, rows[r]+d));
+        _mm512_mask_storeu_ps(out+d, m, _mm512_mul_ps(acc, s));
+    }
+}
+#endif
+
+VectorKernels get_vector_kernels(int isa) {
+    VectorKernels kernels;
+    kernels.isa = ISA_SCALAR;
+    kernels.dot_f64 = dot_scalar<double>;
+    kernels.dot_f32 = dot_scalar<float>;
+    kernels.axpy_f64 = axpy_scalar<double>;
+    kernels.axpy_f32 = axpy_scalar<float>;
+    kernels.axpy_decay_f64 = axpy_decay_scalar<double>;
+    kernels.axpy_decay_f32 = axpy_decay_scalar<float>;
+    kernels.sum_rows_f64 = sum_rows_scalar<double>;
+    kernels.sum_rows_f32 = sum_rows_scalar<float>;
+#ifdef VECTOR_KERNELS_X86
+    if (isa == ISA_SSE2)
+    {
+        kernels.isa = ISA_SSE2;
+        kernels.dot_f64 = dot_f64_sse2;
+        kernels.dot_f32 = dot_f32_sse2;
+        kernels.axpy_f64 = axpy_f64_sse2;
+        kernels.axpy_f32 = axpy_f32_sse2;
+        kernels.axpy_decay_f64 = axpy_decay_f64_sse2;
+        kernels.axpy_decay_f32 = axpy_decay_f32_sse2;
+        kernels.sum_rows_f64 = sum_rows_f64_sse2;
+        kernels.sum_rows_f32 = sum_rows_f32_sse2;
+    }
+    else if (isa == ISA_AVX2)
+    {
+        kernels.isa = ISA_AVX2;
+        kernels.dot_f64 = dot_f64_avx2;
+        kernels.dot_f32 = dot_f32_avx2;
+        kernels.axpy_f64 = axpy_f64_avx2;
+        kernels.axpy_f32 = axpy_f32_avx2;
+        kernels.axpy_decay_f64 = axpy_decay_f64_avx2;
+        kernels.axpy_decay_f32 = axpy_decay_f32_avx2;
+        kernels.sum_rows_f64 = sum_rows_f64_avx2;
+        kernels.sum_rows_f32 = sum_rows_f32_avx2;
+    }
+    else if (isa == ISA_AVX512)
+    {
+        kernels.isa = ISA_AVX512;
+        kernels.dot_f64 = dot_f64_avx512;
+        kernels.dot_f32 = dot_f32_avx512;
+        kernels.axpy_f64 = axpy_f64_avx512;
+        kernels.axpy_f32 = axpy_f32_avx512;
+        kernels.axpy_decay_f64 = axpy_decay_f64_avx512;
+        kernels.axpy_decay_f32 = axpy_decay_f32_avx512;
+        kernels.sum_rows_f64 = sum_rows_f64_avx512;
+        kernels.sum_rows_f32 = sum_rows_f32_avx512;
+    }
+#endif
+    return kernels;
+}
+
+int detect_isa() {
+#ifdef VECTOR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA_SSE2;
+#endif
+    return ISA_SCALAR;
+}
+
+const char* isa_name(int isa) {
+    switch (isa)
+    {
+        case ISA_SSE2: return "sse2";
+        case ISA_AVX2: return "avx2";
+        case ISA_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+int select_vector_kernels(std::string name) {
+    int isa, best_isa = detect_isa();
+    if (name == "auto")
+        isa = best_isa;
+    else if (name == "scalar")
+        isa = ISA_SCALAR;
+    else if (name == "sse2")
+        isa = ISA_SSE2;
+    else if (name == "avx2")
+        isa = ISA_AVX2;
+    else if (name == "avx512")
+        isa = ISA_AVX512;
+    else
+        return -1;
+    if (isa > best_isa) // not supported by this cpu
+        isa = best_isa;
+    vector_kernels = get_vector_kernels(isa);
+    return isa;
+}
+
+// picked once by cpuid when the library is loaded
+VectorKernels vector_kernels = get_vector_kernels(detect_isa());
@@ -0,0 +1,201 @@
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+#include <cmath>
+#include <string>
+#include <vector>
+#include "precision.h"
+
+#define ISA_SCALAR 0
+#define ISA_SSE2 1
+#define ISA_AVX2 2
+#define ISA_AVX512 3
+
+struct VectorKernels {
+    /* VectorKernels is the table of hot-loop kernels for one instruction set.
+     * The active table is picked by cpuid the first time the library is used
+     * and can be overridden with select_vector_kernels().
+     */
+    int isa;
+    // a.b
+    double (*dot_f64)(const double* a, const double* b, int n);
+    float (*dot_f32)(const float* a, const float* b, int n);
+    // y += alpha*x
+    void (*axpy_f64)(double alpha, const double* x, double* y, int n);
+    void (*axpy_f32)(float alpha, const float* x, float* y, int n);
+    // y += alpha*(x - lambda*y)
+    void (*axpy_decay_f64)(double alpha, const double* x, double lambda, double* y, int n);
+    void (*axpy_decay_f32)(float alpha, const float* x, float lambda, float* y, int n);
+    // out = scale*(rows[0] + ... + rows[num_rows-1]); scale = 1/num_rows gives the mean
+    void (*sum_rows_f64)(const double* const* rows, int num_rows, double scale, double* out, int n);
+    void (*sum_rows_f32)(const float* const* rows, int num_rows, float scale, float* out, int n);
+};
+
+extern VectorKernels vector_kernels;
+
+// ISA_* supported by this cpu
+int detect_isa();
+// "auto", "scalar", "sse2", "avx2" or "avx512"; returns the ISA in use, -1 if unknown
+int select_vector_kernels(std::string name);
+const char* isa_name(int isa);
+// the kernel table of a given ISA, used to check kernels against each other
+VectorKernels get_vector_kernels(int isa);
+
+// dispatch by type
+inline double vk_dot(const double* a, const double* b, int n) { return vector_kernels.dot_f64(a, b, n); }
+inline float vk_dot(const float* a, const float* b, int n) { return vector_kernels.dot_f32(a, b, n); }
+inline void vk_axpy(double alpha, const double* x, double* y, int n) { vector_kernels.axpy_f64(alpha, x, y, n); }
+inline void vk_axpy(float alpha, const float* x, float* y, int n) { vector_kernels.axpy_f32(alpha, x, y, n); }
+inline void vk_axpy_decay(double alpha, const double* x, double lambda, double* y, int n) { vector_kernels.axpy_decay_f64(alpha, x, lambda, y, n); }
+inline void vk_axpy_decay(float alpha, const float* x, float lambda, float* y, int n) { vector_kernels.axpy_decay_f32(alpha, x, lambda, y, n); }
+inline void vk_sum_rows(const double* const* rows, int num_rows, double scale, double* out, int n) { vector_kernels.sum_rows_f64(rows, num_rows, scale, out, n); }
+inline void vk_sum_rows(const float* const* rows, int num_rows, float scale, float* out, int n) { vector_kernels.sum_rows_f32(rows, num_rows, scale, out, n); }
+
+// bfloat16 rows are widened element by element; updates round stochastically
+inline void vk_axpy(float alpha, const float* x, bfloat16* y, int n) {
+    for (int d=0; d<n; d++)
+        y[d] = float_to_bfloat16_stochastic(bfloat16_to_float(y[d]) + alpha*x[d]);
+}
+inline void vk_axpy_decay(float alpha, const float* x, float lambda, bfloat16* y, int n) {
+    for (int d=0; d<n; d++)
+    {
+        float value = bfloat16_to_float(y[d]);
+        y[d] = float_to_bfloat16_stochastic(value + alpha*(x[d] - lambda*value));
+    }
+}
+inline void vk_sum_rows(const bfloat16* const* rows, int num_rows, float scale, float* out, int n) {
+    for (int d=0; d<n; d++)
+        out[d] = 0.0;
+    for (int r=0; r<num_rows; r++)
+        for (int d=0; d<n; d++)
+            out[d] += bfloat16_to_float(rows[r][d]);
+    for (int d=0; d<n; d++)
+        out[d] *= scale;
+}
+
+// dimension-specialized kernels: DIM > 0 is a compile-time loop bound the
+// compiler can fully unroll and keep in registers once inlined into a
+// training step; DIM == 0 is the generic fallback to the dispatched kernels.
+// Put VECTOR_KERNEL_CLONES on the function they are inlined into, so that it
+// is compiled once per ISA and picked by cpuid at load time as well (ISA
+// flags only: an arch= clone would refuse to inline the default-arch kernels).
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VECTOR_KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_KERNEL_CLONES
+#endif
+
+template<typename R, int DIM>
+class DimVector {
+    /* DimVector is a stack buffer of DIM elements, or a heap one for DIM == 0.
+     */
+    public:
+        alignas(64) R data[DIM];
+        DimVector(int) {}
+        R* ptr() { return this->data; }
+};
+
+template<typename R>
+class DimVector<R, 0> {
+    public:
+        std::vector<R> data;
+        DimVector(int dimension) : data(dimension) {}
+        R* ptr() { return this->data.data(); }
+};
+
+template<int DIM, typename R>
+inline void dim_zero(R* x, int dimension) {
+    const int n = DIM ? DIM : dimension;
+    for (int d=0; d<n; d++)
+        x[d] = 0;
+}
+
+template<int DIM, typename R>
+inline R dim_dot(const R* __restrict a, const R* __restrict b, int dimension) {
+    if (DIM == 0)
+        return vk_dot(a, b, dimension);
+    R result = 0;
+    for (int d=0; d<DIM; d++)
+        result += a[d]*b[d];
+    return result;
+}
+
+template<int DIM, typename R>
+inline void dim_axpy(R alpha, const R* __restrict x, R* __restrict y, int dimension) {
+    if (DIM == 0)
+    {
+        vk_axpy(alpha, x, y, dimension);
+        return;
+    }
+    for (int d=0; d<DIM; d++)
+        y[d] += alpha*x[d];
+}
+
+template<int DIM, typename R, typename T>
+inline void dim_axpy_decay(R alpha, const R* __restrict x, R lambda, T* __restrict y, int dimension) {
+    if (DIM == 0)
+    {
+        vk_axpy_decay(alpha, x, lambda, y, dimension);
+        return;
+    }
+    for (int d=0; d<DIM; d++)
+    {
+        R value = StorageTraits<T>::load(y[d]);
+        y[d] = StorageTraits<T>::store_stochastic(value + alpha*(x[d] - lambda*value));
+    }
+}
+
+// adaptive updates on one row; `state` is the row's optimizer state.
+// AdaGrad: state = accumulated squared gradients [dimension]
+template<int DIM, typename R, typename T>
+inline void dim_adagrad_decay(R alpha, const R* __restrict x, R lambda, T* __restrict y, R* __restrict state, int dimension) {
+    const int n = DIM ? DIM : dimension;
+    for (int d=0; d<n; d++)
+    {
+        R value = StorageTraits<T>::load(y[d]);
+        R gradient = x[d] - lambda*value;
+        state[d] += gradient*gradient;
+        y[d] = StorageTraits<T>::store_stochastic(value + alpha*gradient/std::sqrt(state[d]));
+    }
+}
+
+// lazy Adam: state = [first moment [dimension], second moment [dimension], row step];
+// only the touched row advances its moments and its own bias-correction step
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define ADAM_EPSILON 1e-8
+#define ADAM_WARM_STEPS 10000
+template<int DIM, typename R, typename T>
+inline void dim_adam_decay(R alpha, const R* __restrict x, R lambda, T* __restrict y, R* __restrict state, int dimension) {
+    const int n = DIM ? DIM : dimension;
+    R* first_moment = state;
+    R* second_moment = state + n;
+    R step = alpha;
+    if (state[2*n] < ADAM_WARM_STEPS)
+    {
+        state[2*n] += 1;
+        step = alpha*std::sqrt(1 - std::pow((R)ADAM_BETA2, state[2*n]))/(1 - std::pow((R)ADAM_BETA1, state[2*n]));
+    }
+    for (int d=0; d<n; d++)
+    {
+        R value = StorageTraits<T>::load(y[d]);
+        R gradient = x[d] - lambda*value;
+        first_moment[d] = ADAM_BETA1*first_moment[d] + (1-ADAM_BETA1)*gradient;
+        second_moment[d] = ADAM_BETA2*second_moment[d] + (1-ADAM_BETA2)*gradient*gradient;
+        y[d] = StorageTraits<T>::store_stochastic(value + step*first_moment[d]/(std::sqrt(second_moment[d]) + (R)ADAM_EPSILON));
+    }
+}
+
+// out = scale*(a + b)
+template<int DIM, typename R, typename T>
+inline void dim_sum2(const T* a, const T* b, R scale, R* __restrict out, int dimension) {
+    if (DIM == 0)
+    {
+        const T* rows[2] = {a, b};
+        vk_sum_rows(rows, 2, scale, out, dimension);
+        return;
+    }
+    for (int d=0; d<DIM; d++)
+        out[d] = scale*(StorageTraits<T>::load(a[d]) + StorageTraits<T>::load(b[d]));
+}
+
+#endif
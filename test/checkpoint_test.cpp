@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../src/util/checkpoint.h"
+#include "../src/util/precision.h"
+#include "../src/util/random.h"
+#include "../src/mapper/lookup_mapper.h"
+
+/* Writes a buffer through the Checkpointer thread and reads it back with
+ * load_checkpoint: the bytes, the step and the learning rate must come back
+ * as they were, and a checkpoint of another layout must be refused.
+ */
+#define CHECKPOINT_TEST_SIZE 1000
+#define CHECKPOINT_TEST_DIMENSION 24
+
+int main(int argc, char **argv){
+    std::string path = "/tmp/checkpoint_test." + std::to_string(getpid());
+    long stride = 2*CHECKPOINT_TEST_DIMENSION;
+    size_t bytes = sizeof(float)*CHECKPOINT_TEST_SIZE*stride;
+    std::vector<float> saved(CHECKPOINT_TEST_SIZE*stride), loaded(CHECKPOINT_TEST_SIZE*stride, 0);
+    unsigned long long state = 0xC4EC4ULL;
+    for (size_t i=0; i<saved.size(); i++)
+        saved[i] = 2*seeded_uniform(&state) - 1;
+    int failures = 0;
+
+    CheckpointHeader header = make_checkpoint_header(PRECISION_FLOAT, UPDATE_ADAGRAD, CHECKPOINT_TEST_SIZE, CHECKPOINT_TEST_DIMENSION, stride, bytes);
+    {
+        Checkpointer checkpointer(path, header, saved.data());
+        checkpointer.request(123456789ULL, 0.0125);
+        checkpointer.wait();
+    }
+
+    CheckpointHeader expected = make_checkpoint_header(PRECISION_FLOAT, UPDATE_ADAGRAD, CHECKPOINT_TEST_SIZE, CHECKPOINT_TEST_DIMENSION, stride, bytes);
+    if (!load_checkpoint(path, expected, loaded.data()))
+    {
+        printf("\tcheckpoint not found at %s\n", path.c_str());
+        failures++;
+    }
+    else if (memcmp(saved.data(), loaded.data(), bytes) || expected.step != 123456789ULL || expected.alpha != 0.0125)
+    {
+        printf("\tcheckpoint: buffer, step or alpha differ after the round trip\n");
+        failures++;
+    }
+
+    // another dimension, same bytes: not this model's checkpoint
+    CheckpointHeader other = make_checkpoint_header(PRECISION_FLOAT, UPDATE_ADAGRAD, CHECKPOINT_TEST_SIZE, 2*CHECKPOINT_TEST_DIMENSION, stride, bytes);
+    try {
+        load_checkpoint(path, other, loaded.data());
+        printf("\tcheckpoint: a mismatched layout was loaded\n");
+        failures++;
+    } catch (const std::runtime_error&) {
+    }
+    unlink(path.c_str());
+
+    CheckpointHeader missing = header;
+    if (load_checkpoint(path, missing, loaded.data()))
+    {
+        printf("\tcheckpoint: a removed checkpoint was loaded\n");
+        failures++;
+    }
+
+    printf("checkpoint round trip: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
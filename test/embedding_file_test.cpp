@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "../src/util/file_graph.h"
+#include "../src/util/precision.h"
+#include "../src/mapper/embedding_file.h"
+#include "../src/mapper/lookup_mapper.h"
+
+/* Saves the rows of a mapper with save_to_binary and maps the file back with
+ * EmbeddingFile, in every storage precision: the names, the layout and every
+ * value must come back exactly. The dimension is odd so the rows are padded.
+ */
+#define EMBEDDING_FILE_TEST_NODES 300
+#define EMBEDDING_FILE_TEST_DIMENSION 13
+
+template<typename T>
+int check(FileGraph& file_graph, std::vector<long>& indexes, std::string path) {
+    LookupMapper<T> mapper(EMBEDDING_FILE_TEST_NODES, EMBEDDING_FILE_TEST_DIMENSION);
+    if (!mapper.save_to_binary(&file_graph, indexes, path))
+    {
+        printf("\t%s: fail to save %s\n", StorageTraits<T>::name(), path.c_str());
+        return 1;
+    }
+    int failures = 0;
+    {
+        EmbeddingFile binary(path);
+        if (binary.rows != (long)indexes.size() || binary.dimension != EMBEDDING_FILE_TEST_DIMENSION
+            || binary.precision != StorageTraits<T>::precision())
+        {
+            printf("\t%s: header holds %ld rows, dimension %d, precision %d\n", StorageTraits<T>::name(), binary.rows, binary.dimension, binary.precision);
+            failures++;
+        }
+        for (long r=0; r<binary.rows && !failures; r++)
+        {
+            if (strcmp(binary.name(r), file_graph.index2node[indexes[r]]))
+            {
+                printf("\t%s: row %ld is named %s, not %s\n", StorageTraits<T>::name(), r, binary.name(r), file_graph.index2node[indexes[r]]);
+                failures++;
+            }
+            T* row = mapper.row(indexes[r]);
+            for (int d=0; d<binary.dimension; d++)
+                if (binary.get(r, d) != (double)StorageTraits<T>::load(row[d]))
+                {
+                    printf("\t%s: row %ld differs at d=%d\n", StorageTraits<T>::name(), r, d);
+                    failures++;
+                    break;
+                }
+        }
+    }
+    unlink(path.c_str());
+    printf("embedding file %s: %s\n", StorageTraits<T>::name(), failures ? "FAIL" : "ok");
+    return failures;
+}
+
+int main(int argc, char **argv){
+    // a chain over the nodes, named n0 .. n<N-1>
+    std::vector<std::string> names(EMBEDDING_FILE_TEST_NODES);
+    std::vector<char*> index2node(EMBEDDING_FILE_TEST_NODES);
+    std::vector<long> from(EMBEDDING_FILE_TEST_NODES-1), to(EMBEDDING_FILE_TEST_NODES-1);
+    for (long index=0; index<EMBEDDING_FILE_TEST_NODES; index++)
+    {
+        names[index] = "n" + std::to_string(index);
+        index2node[index] = (char*)names[index].c_str();
+    }
+    for (long e=0; e<EMBEDDING_FILE_TEST_NODES-1; e++)
+    {
+        from[e] = e;
+        to[e] = e+1;
+    }
+    EdgeArrays edges = {EMBEDDING_FILE_TEST_NODES-1, from.data(), to.data(), NULL};
+    FileGraph file_graph(edges, 0, index2node);
+
+    // every other row, last first, so the file order is not the table's
+    std::vector<long> indexes;
+    for (long index=EMBEDDING_FILE_TEST_NODES-1; index>=0; index-=2)
+        indexes.push_back(index);
+
+    std::string path = "/tmp/embedding_file_test." + std::to_string(getpid());
+    int failures = check<double>(file_graph, indexes, path)
+                 + check<float>(file_graph, indexes, path)
+                 + check<bfloat16>(file_graph, indexes, path);
+    return failures ? 1 : 0;
+}
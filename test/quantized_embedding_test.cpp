@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "../src/util/file_graph.h"
+#include "../src/mapper/lookup_mapper.h"
+#include "../src/mapper/quantized_embedding.h"
+
+/* Saves the rows of a float mapper with save_to_quantized as int8 and maps
+ * the file back with QuantizedEmbedding: every decoded value must be within
+ * half a step (scale/2) of the saved one, the scale must be the row's largest
+ * magnitude over 127, and dot() must agree with the decoded row.
+ */
+#define QUANTIZED_TEST_NODES 300
+#define QUANTIZED_TEST_DIMENSION 13
+// float rounding of x*127/max and of scale*code, relative to the scale
+#define QUANTIZED_TEST_SLACK 1e-4
+
+int main(int argc, char **argv){
+    std::vector<std::string> names(QUANTIZED_TEST_NODES);
+    std::vector<char*> index2node(QUANTIZED_TEST_NODES);
+    std::vector<long> from(QUANTIZED_TEST_NODES-1), to(QUANTIZED_TEST_NODES-1);
+    for (long index=0; index<QUANTIZED_TEST_NODES; index++)
+    {
+        names[index] = "n" + std::to_string(index);
+        index2node[index] = (char*)names[index].c_str();
+    }
+    for (long e=0; e<QUANTIZED_TEST_NODES-1; e++)
+    {
+        from[e] = e;
+        to[e] = e+1;
+    }
+    EdgeArrays edges = {QUANTIZED_TEST_NODES-1, from.data(), to.data(), NULL};
+    FileGraph file_graph(edges, 0, index2node);
+
+    LookupMapper<float> mapper(QUANTIZED_TEST_NODES, QUANTIZED_TEST_DIMENSION);
+    // one all-zero row, whose scale is 0
+    memset(mapper.row(7), 0, sizeof(float)*QUANTIZED_TEST_DIMENSION);
+    std::vector<long> indexes;
+    for (long index=QUANTIZED_TEST_NODES-1; index>=0; index--)
+        indexes.push_back(index);
+
+    std::string path = "/tmp/quantized_embedding_test." + std::to_string(getpid());
+    if (!mapper.save_to_quantized(&file_graph, indexes, path, QUANTIZE_INT8, 0))
+    {
+        printf("quantized embedding int8: FAIL to save %s\n", path.c_str());
+        return 1;
+    }
+    int failures = 0;
+    {
+        QuantizedEmbedding quantized(path);
+        if (quantized.rows != (long)indexes.size() || quantized.dimension != QUANTIZED_TEST_DIMENSION || quantized.kind != QUANTIZE_INT8)
+        {
+            printf("\theader holds %ld rows, dimension %d, kind %d\n", quantized.rows, quantized.dimension, quantized.kind);
+            failures++;
+        }
+        std::vector<float> decoded(QUANTIZED_TEST_DIMENSION), query(QUANTIZED_TEST_DIMENSION);
+        for (int d=0; d<QUANTIZED_TEST_DIMENSION; d++)
+            query[d] = (float)(d+1)/QUANTIZED_TEST_DIMENSION;
+        for (long r=0; r<quantized.rows && !failures; r++)
+        {
+            const float* row = mapper.row(indexes[r]);
+            float scale, largest = 0;
+            memcpy(&scale, quantized.codes(r), sizeof(float));
+            for (int d=0; d<QUANTIZED_TEST_DIMENSION; d++)
+                largest = std::fabs(row[d]) > largest ? std::fabs(row[d]) : largest;
+            if (std::fabs(scale - largest/127) > QUANTIZED_TEST_SLACK*scale || strcmp(quantized.name(r), index2node[indexes[r]]))
+            {
+                printf("\trow %ld: scale %g for a largest magnitude of %g, named %s\n", r, scale, largest, quantized.name(r));
+                failures++;
+                break;
+            }
+            quantized.decode(r, decoded.data());
+            double dot = 0;
+            for (int d=0; d<QUANTIZED_TEST_DIMENSION; d++)
+            {
+                if (std::fabs(decoded[d] - row[d]) > scale*(0.5 + QUANTIZED_TEST_SLACK))
+                {
+                    printf("\trow %ld: %g decodes to %g, more than scale/2 = %g off\n", r, row[d], decoded[d], scale/2);
+                    failures++;
+                    break;
+                }
+                dot += decoded[d]*query[d];
+            }
+            if (std::fabs(quantized.dot(r, query.data()) - dot) > 1e-5*(std::fabs(dot) + 1))
+            {
+                printf("\trow %ld: dot %g, decoded row . query %g\n", r, quantized.dot(r, query.data()), dot);
+                failures++;
+            }
+        }
+    }
+    unlink(path.c_str());
+    printf("quantized embedding int8: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
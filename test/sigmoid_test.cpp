@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <cmath>
+#include "../src/optimizer/loss_kernels.h"
+
+/* Checks fast_sigmoid against 1/(1+exp(-x)) on a grid much finer than the
+ * table, past both ends of its range.
+ */
+#define SIGMOID_TEST_POINTS 10000000
+#define SIGMOID_TEST_RANGE 24.0
+// linear interpolation with step h = 2*MAX_SIGMOID/SIGMOID_TABLE_SIZE = 1/64
+// is off by at most h^2*max|sigmoid''|/8 = h^2/(48*sqrt(3)) ~ 2.94e-6, which
+// the table reaches; the bound leaves ~1e-6 for rounding and the clamped
+// tails (1.2e-7), so a coarser table or a wrong index still fails
+#define SIGMOID_TEST_MAX_ERROR 4e-6
+
+int main(int argc, char **argv){
+    double max_error = 0, worst = 0;
+    for (long i=0; i<=SIGMOID_TEST_POINTS; i++)
+    {
+        double x = -SIGMOID_TEST_RANGE + 2.0*SIGMOID_TEST_RANGE*i/SIGMOID_TEST_POINTS;
+        double error = std::fabs(fast_sigmoid(x) - 1.0/(1.0 + std::exp(-x)));
+        if (error > max_error)
+        {
+            max_error = error;
+            worst = x;
+        }
+    }
+    printf("sigmoid table: max error %.2e at %.4f (bound %.0e)\n", max_error, worst, SIGMOID_TEST_MAX_ERROR);
+    return max_error <= SIGMOID_TEST_MAX_ERROR ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include "../src/util/vector_kernels.h"
+#include "../src/util/random.h"
+
+/* Checks every vector kernel of every ISA this cpu supports against the
+ * scalar ones, for n = 0..VK_TEST_MAX_N in float and double, so that the
+ * vector bodies and their remainder loops are all covered.
+ */
+#define VK_TEST_MAX_N 70
+#define VK_TEST_ROWS 3
+
+// the kernels of one element type
+struct KernelsF64 {
+    typedef double real;
+    static double dot(VectorKernels& k, const double* a, const double* b, int n) { return k.dot_f64(a, b, n); }
+    static void axpy(VectorKernels& k, double alpha, const double* x, double* y, int n) { k.axpy_f64(alpha, x, y, n); }
+    static void axpy_decay(VectorKernels& k, double alpha, const double* x, double lambda, double* y, int n) { k.axpy_decay_f64(alpha, x, lambda, y, n); }
+    static void sum_rows(VectorKernels& k, const double* const* rows, int num_rows, double scale, double* out, int n) { k.sum_rows_f64(rows, num_rows, scale, out, n); }
+    static double tolerance() { return 1e-12; }
+    static const char* name() { return "double"; }
+};
+
+struct KernelsF32 {
+    typedef float real;
+    static float dot(VectorKernels& k, const float* a, const float* b, int n) { return k.dot_f32(a, b, n); }
+    static void axpy(VectorKernels& k, float alpha, const float* x, float* y, int n) { k.axpy_f32(alpha, x, y, n); }
+    static void axpy_decay(VectorKernels& k, float alpha, const float* x, float lambda, float* y, int n) { k.axpy_decay_f32(alpha, x, lambda, y, n); }
+    static void sum_rows(VectorKernels& k, const float* const* rows, int num_rows, float scale, float* out, int n) { k.sum_rows_f32(rows, num_rows, scale, out, n); }
+    static double tolerance() { return 1e-5; }
+    static const char* name() { return "float"; }
+};
+
+static unsigned long long state = 0x7E57ULL;
+static double draw() { return 2*seeded_uniform(&state) - 1; }
+
+// |got - expected| within tolerance of the magnitude of the terms summed
+static int close(double got, double expected, double magnitude, double tolerance) {
+    return std::fabs(got - expected) <= tolerance*(magnitude + 1.0);
+}
+
+template<typename K>
+int check(VectorKernels& scalar, VectorKernels& vector) {
+    typedef typename K::real real;
+    int failures = 0;
+    for (int n=0; n<=VK_TEST_MAX_N; n++)
+    {
+        std::vector<real> a(n+1), b(n+1), y_scalar(n+1), y_vector(n+1);
+        std::vector<std::vector<real> > rows(VK_TEST_ROWS, std::vector<real>(n+1));
+        for (int d=0; d<n; d++)
+        {
+            a[d] = draw();
+            b[d] = draw();
+            y_scalar[d] = y_vector[d] = draw();
+            for (int r=0; r<VK_TEST_ROWS; r++)
+                rows[r][d] = draw();
+        }
+        // the element past n must stay untouched
+        a[n] = b[n] = y_scalar[n] = y_vector[n] = 7;
+
+        double magnitude = 0;
+        for (int d=0; d<n; d++)
+            magnitude += std::fabs(a[d]*b[d]);
+        if (!close(K::dot(vector, a.data(), b.data(), n), K::dot(scalar, a.data(), b.data(), n), magnitude, K::tolerance()))
+        {
+            printf("\t%s %s dot: mismatch at n=%d\n", isa_name(vector.isa), K::name(), n);
+            failures++;
+        }
+
+        K::axpy(scalar, (real)0.3, a.data(), y_scalar.data(), n);
+        K::axpy(vector, (real)0.3, a.data(), y_vector.data(), n);
+        K::axpy_decay(scalar, (real)0.3, b.data(), (real)0.01, y_scalar.data(), n);
+        K::axpy_decay(vector, (real)0.3, b.data(), (real)0.01, y_vector.data(), n);
+        for (int d=0; d<=n; d++)
+            if (!close(y_vector[d], y_scalar[d], 1.0, K::tolerance()))
+            {
+                printf("\t%s %s axpy/axpy_decay: mismatch at n=%d, d=%d\n", isa_name(vector.isa), K::name(), n, d);
+                failures++;
+                break;
+            }
+
+        const real* row_pointers[VK_TEST_ROWS];
+        for (int r=0; r<VK_TEST_ROWS; r++)
+            row_pointers[r] = rows[r].data();
+        for (int num_rows=1; num_rows<=VK_TEST_ROWS; num_rows++)
+        {
+            std::vector<real> out_scalar(n+1, 7), out_vector(n+1, 7);
+            K::sum_rows(scalar, row_pointers, num_rows, (real)1/num_rows, out_scalar.data(), n);
+            K::sum_rows(vector, row_pointers, num_rows, (real)1/num_rows, out_vector.data(), n);
+            for (int d=0; d<=n; d++)
+                if (!close(out_vector[d], out_scalar[d], 1.0, K::tolerance()))
+                {
+                    printf("\t%s %s sum_rows(%d): mismatch at n=%d, d=%d\n", isa_name(vector.isa), K::name(), num_rows, n, d);
+                    failures++;
+                    break;
+                }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv){
+    VectorKernels scalar = get_vector_kernels(ISA_SCALAR);
+    int failures = 0;
+    for (int isa=ISA_SSE2; isa<=detect_isa(); isa++)
+    {
+        VectorKernels vector = get_vector_kernels(isa);
+        int isa_failures = check<KernelsF64>(scalar, vector) + check<KernelsF32>(scalar, vector);
+        printf("vector kernels %s: %s\n", isa_name(isa), isa_failures ? "FAIL" : "ok");
+        failures += isa_failures;
+    }
+    return failures ? 1 : 0;
+}